@@ -4,13 +4,23 @@
 #include <string.h>
 #include <ctype.h>
 #include <termios.h>
+#include <signal.h>
+#include <poll.h>
 #include <unistd.h>
+#include <stdint.h>
 
 // board constants (both below 2, the lowest # tile)
 #define EMPTY 0 
 #define EDGE  1 
 
-// board location constants
+// board size constants, a game's size (tiles on each side) is picked when it is created
+#define MIN_BOARD_SIZE     3
+#define MAX_BOARD_SIZE     6
+#define DEFAULT_BOARD_SIZE 4
+#define MAX_BOARD_LENGTH   (MAX_BOARD_SIZE + 2) // length of each side of the biggest board with its edges
+
+// board location constants (END, EDGE_END and BOARD_LENGTH are those of the default 4x4 board,
+// a board of any size runs from START to game->size with its far edges at game->size + 1)
 #define BOARD_LENGTH 6 // length of each side of the board
 #define EDGE_START   0 // value where an edge can occur
 #define EDGE_END     5 // another value where an edge can occur
@@ -23,43 +33,339 @@
 #define EAST  2
 #define WEST  3
 
+// step of each direction (NORTH, SOUTH, EAST, WEST) in cols and rows, defined in "2048_funcs.c"
+extern int dir_x[4];
+extern int dir_y[4];
+
+// steps of the 8 symmetries of a 4x4 board, a transform is an OR of them applied in this order
+#define SYMMETRY_TRANSPOSE 4 // rows become cols
+#define SYMMETRY_FLIP      2 // row order is reversed
+#define SYMMETRY_MIRROR    1 // cells of each row are reversed
+
 // constants defining game status
 #define INIT    0
 #define RUNNING 1
 #define DONE    2
 
 // levels for logging
-#define NO_LOG  0
-#define LOGGING 1
+#define NO_LOG    0
+#define LOGGING   1
+#define PROFILING 2 // LOGGING plus a summary of the instrumentation counters (builds made with INSTRUMENT=1)
 
 // constants for picking tiles
 #define STANDARD 2
 #define SPECIAL  4
 
+// constants for the packed bitboard (16 cells of 4 bits each, row-major from the top-left)
+#define BITBOARD_LENGTH 4      // length of each side of the packed board (no edges)
+#define CELL_BITS       4      // bits used by each cell to hold its log2 exponent
+#define ROW_BITS        16     // bits used by each row of 4 cells
+#define CELL_MASK       0xFULL
+#define ROW_MASK        0xFFFFULL
+#define ROW_COUNT       65536  // amount of distinct packed rows (2^ROW_BITS)
+
+// constants for the successor cache of bitboard moves
+#define MOVE_CACHE_BITS 16 // cache holds 2^MOVE_CACHE_BITS moves (1.5 MB)
+#define MOVE_CACHE_SIZE (1 << MOVE_CACHE_BITS)
+
 // constants for checking if the game is over
 #define NOT_CHECKING 0
 #define CHECKING     1
 
-// node struct used to create list
-typedef struct list_node
-{
-    int row, col; // coordinates that the node holds
-    struct list_node *next; // pointer to another node in the list
-}
-list_node_t;
+// capacity of the empty list, one slot for every row-col location of the biggest padded board
+#define EMPTY_LIST_CAPACITY (MAX_BOARD_LENGTH * MAX_BOARD_LENGTH)
+#define NOT_IN_LIST         -1
 
-// struct that mimics a list; primarily used to create a list of "empty" tiles
+/*
+    struct that mimics a list; primarily used to create a list of "empty" tiles
+    locations are kept in a dense array, with a position map from each location to its index in that array,
+    so add, remove, contains and random pick are all O(1) and never allocate
+*/
 typedef struct
 {
-    list_node_t *front; // pointer to front of list for traversal
+    int cells[EMPTY_LIST_CAPACITY]; // dense array of locations (row * MAX_BOARD_LENGTH + col)
+    int position[EMPTY_LIST_CAPACITY]; // index of each location in cells, NOT_IN_LIST if absent
     int length; // amount of tiles in the list
 }
 empty_list_t;
 
+// 4x4 board packed into a value type; each cell holds the log2 exponent of its tile (0 for EMPTY)
+typedef uint64_t board_t;
+
+// state of the xoshiro256** random number generator, one per game so games can run on any thread
+typedef struct
+{
+    uint64_t s[4];
+}
+rng_t;
+
+// precomputed result of sliding one packed row, used for the row transition tables
+typedef struct
+{
+    uint16_t row; // packed row after the slide
+    uint16_t changed; // 1 if the slide moved or merged any tile, otherwise 0
+    int points; // points gained from merges during the slide
+}
+row_move_t;
+
+// weights of each heuristic term of the evaluation, loadable from a config file
+typedef struct
+{
+    float lost_penalty; // constant added to every row so scores stay above those of lost boards
+    float empty_weight; // reward for each empty cell
+    float merges_weight; // reward for each pair of adjacent equal tiles
+    float monotonicity_power; // exponent applied to tiles before measuring monotonicity
+    float monotonicity_weight; // penalty for rows that go up and down instead of one way
+    float sum_power; // exponent applied to tiles before summing them
+    float sum_weight; // penalty for the (powered) sum of the tiles
+    float smoothness_weight; // penalty for differences between adjacent tiles
+    float corner_weight; // reward for a row whose biggest tile sits at one of its ends
+}
+eval_weights_t;
+
+// constants for n-tuple networks (board values learned by "./train")
+#define NTUPLE_MAGIC         0x544E3834U // "48NT" when read as little-endian bytes
+#define NTUPLE_VERSION       1
+#define NTUPLE_COUNT         4 // tuples of the network
+#define NTUPLE_LENGTH        4 // cells of each tuple
+#define NTUPLE_ENTRIES       (1 << (NTUPLE_LENGTH * CELL_BITS)) // weights of each tuple, one per combination of exponents
+#define NTUPLE_LOOKUPS       (NTUPLE_COUNT * 8) // every tuple is looked up in all 8 symmetries of the board
+#define NTUPLE_DEFAULT_PATH  "ntuple.weights"
+
+/*
+    header at the start of a weights file (64 bytes), the tables follow it as
+    NTUPLE_COUNT arrays of NTUPLE_ENTRIES floats, so a mapped file is used in place
+*/
+typedef struct
+{
+    uint32_t magic; // NTUPLE_MAGIC
+    uint16_t version; // NTUPLE_VERSION
+    uint16_t tuple_count; // NTUPLE_COUNT of the writer
+    uint32_t tuple_length; // NTUPLE_LENGTH of the writer
+    uint32_t reserved;
+    uint64_t games; // self-play games the weights were trained on
+    uint8_t cells[NTUPLE_COUNT][NTUPLE_LENGTH]; // cells (row * 4 + col) of each tuple, the lowest index first
+    uint8_t padding[64 - 24 - NTUPLE_COUNT * NTUPLE_LENGTH];
+}
+ntuple_header_t;
+
+// n-tuple network, either allocated for training or mapped from a weights file
+typedef struct
+{
+    ntuple_header_t *header; // start of the allocation or mapping
+    float *weights; // NTUPLE_COUNT tables right after the header, weight e of tuple t is weights[t * NTUPLE_ENTRIES + e]
+    size_t size; // bytes of the header and the tables
+    int mapped; // 1 if the weights are a mapping of a file, 0 if they were allocated
+}
+ntuple_net_t;
+
+// constants for binary game logs
+#define LOG_MAGIC      0x474F4C38U // "8LOG" when read as little-endian bytes
+#define LOG_VERSION    1
+#define LOG_HAS_SPAWNS 1           // flag set when the log stores every spawned tile
+
+// fixed-size header at the start of every game log in a file
+typedef struct
+{
+    uint32_t magic; // LOG_MAGIC
+    uint16_t version; // LOG_VERSION
+    uint16_t flags; // LOG_HAS_SPAWNS or 0
+    uint64_t seed; // seed the game's rng was seeded with
+    uint32_t move_count; // amount of moves, stored 4 per byte after the header
+    uint32_t spawn_count; // amount of spawns, stored 1 per byte after the moves if LOG_HAS_SPAWNS is set
+    uint32_t final_points; // points at the end of the game, used to verify replays
+    uint32_t highest_tile; // highest tile at the end of the game, used to verify replays
+}
+game_log_header_t;
+
+// log of one game kept in memory while recording or replaying
+typedef struct
+{
+    game_log_header_t header;
+    uint8_t *moves; // 2 bits per move
+    uint8_t *spawns; // 1 byte per spawn (cell | (exponent - 1) << 4), NULL if spawns are not recorded
+    uint32_t capacity; // amount of moves the arrays can hold before growing
+}
+game_log_t;
+
+// constants for columnar datasets of simulated moves
+#define DATASET_MAGIC      0x53443834U // "48DS" when read as little-endian bytes
+#define DATASET_VERSION    1
+#define DATASET_BLOCK_ROWS 8192        // rows in every block, blocks are always written whole
+
+// header at the start of a dataset file, rewritten when the file is closed
+typedef struct
+{
+    uint32_t magic; // DATASET_MAGIC
+    uint16_t version; // DATASET_VERSION
+    uint16_t reserved;
+    uint32_t block_rows; // DATASET_BLOCK_ROWS of the writer
+    uint32_t block_count; // amount of blocks after the header
+    uint64_t row_count; // amount of rows in all blocks
+}
+dataset_header_t;
+
+/*
+    fixed-size block of dataset rows stored column by column, written and mapped exactly as laid out here
+    row i of the block is (boards[i], moves[i], rewards[i], terminal[i]), rows past row_count are zero
+*/
+typedef struct
+{
+    uint32_t row_count; // amount of rows used in this block
+    uint32_t reserved;
+    board_t boards[DATASET_BLOCK_ROWS]; // board before the move
+    int32_t rewards[DATASET_BLOCK_ROWS]; // points gained by the move
+    uint8_t moves[DATASET_BLOCK_ROWS]; // direction of the move
+    uint8_t terminal[DATASET_BLOCK_ROWS]; // 1 if the game was over after the move (and its random tile)
+}
+dataset_block_t;
+
+// dataset file being written, shared by every writer; blocks reserve their offset with one atomic add
+typedef struct
+{
+    int fd;
+    _Atomic uint64_t next_block; // index of the next block to be written
+    _Atomic uint64_t row_count; // rows in every block written so far
+}
+dataset_file_t;
+
+// per-thread writer that fills one block in memory and writes it to the file once it is full
+typedef struct
+{
+    dataset_file_t *file;
+    dataset_block_t block;
+}
+dataset_writer_t;
+
+// dataset file mapped read-only, columns are read in place with no copies
+typedef struct
+{
+    dataset_header_t *header;
+    dataset_block_t *blocks; // header->block_count blocks right after the header
+    uint64_t *block_starts; // index of the first row of each block, for random access by row
+    size_t size; // size of the mapping
+}
+dataset_t;
+
+// constants for the terminal renderer
+#define RENDER_BUFFER_SIZE  4096 // bytes of one frame, a full repaint fits with room to spare
+#define RENDER_MESSAGE_SIZE 128  // longest status message shown under the board
+#define RENDER_CELL_WIDTH   6    // characters used by each tile, same as game_print()
+#define RENDER_FPS          30   // frame rate cap of AI play in the interactive program
+
+/*
+    state of the in-place terminal renderer
+    keeps what is currently on screen so each frame only redraws the cells and lines that changed
+*/
+typedef struct
+{
+    char buffer[RENDER_BUFFER_SIZE]; // frame being built, sent with one write()
+    int length; // bytes used in buffer
+    char *header; // text drawn above the board on every full repaint
+    int header_lines; // amount of lines in header
+    int drawn; // 0 until the first frame, or after render_invalidate(), forces a full repaint
+    int cells[MAX_BOARD_SIZE * MAX_BOARD_SIZE]; // tile values currently on screen
+    int points; // points currently on screen
+    int highest_tile; // highest tile currently on screen
+    char message[RENDER_MESSAGE_SIZE]; // message to show on the next frame
+    char drawn_message[RENDER_MESSAGE_SIZE]; // message currently on screen
+    long long frame_interval; // least nanoseconds between two frames, 0 for no cap
+    long long last_frame; // time of the last frame in nanoseconds
+    long frames; // amount of frames written
+    long skipped; // amount of frames skipped by the cap
+    long bytes; // amount of bytes written
+}
+renderer_t;
+
+// capacity of the key queue, also the most moves applied before a frame is drawn
+#define KEY_QUEUE_CAPACITY 64
+
+// ring buffer of keys read from the terminal but not applied yet
+typedef struct
+{
+    int keys[KEY_QUEUE_CAPACITY];
+    int head; // index of the oldest key
+    int count; // amount of keys in the queue
+}
+key_queue_t;
+
+// constants for the undo/redo history
+#define SNAPSHOT_CELLS      (MAX_BOARD_SIZE * MAX_BOARD_SIZE) // one exponent byte per cell, tiles of big boards pass 2^15
+#define HISTORY_CAPACITY    32768 // turns kept for undo (2.25 MB of snapshots), the oldest are dropped after that
+
+// compact record of one turn, everything needed to put a game back where it was (72 bytes)
+typedef struct
+{
+    rng_t rng; // random tile generator, so redoing a turn or playing on spawns the same tiles
+    uint8_t cells[SNAPSHOT_CELLS]; // log2 exponent of every tile, row-major, the highest tile is the biggest of them
+    int32_t points;
+}
+game_snapshot_t;
+
+// ring buffer of snapshots, turn t lives in slot t % HISTORY_CAPACITY
+typedef struct
+{
+    game_snapshot_t *snapshots;
+    long oldest; // oldest turn that can still be restored
+    long current; // turn the game is at
+    long newest; // newest turn that can be redone
+}
+game_history_t;
+
+// constants for the game server protocol (see 2048_server.c), every field is little-endian
+#define SERVER_SOCKET_PATH   "/tmp/2048.sock" // default Unix socket of ./server and ./loadgen
+#define SERVER_MAX_SESSIONS  65536 // session ids keep the slot in their low 16 bits
+#define SERVER_MAX_CLIENTS   1024
+#define SERVER_BUFFER_SIZE   65536 // bytes of each client's input and output buffers
+#define SERVER_MAX_BATCH     255   // most moves in one SERVER_BATCH request
+
+// request types
+#define SERVER_NEW_GAME 0 // starts a session, followed by a uint64_t seed
+#define SERVER_MOVE     1 // moves the session's game in dir
+#define SERVER_STATE    2 // reads the session's game
+#define SERVER_BATCH    3 // followed by count direction bytes, applied in order until the game is over
+#define SERVER_CLOSE    4 // ends the session
+
+// response statuses
+#define SERVER_OK          0
+#define SERVER_BAD_SESSION 1 // no such session, or it was closed
+#define SERVER_BAD_REQUEST 2 // unknown type or direction
+#define SERVER_FULL        3 // every session is taken
+
+// fixed-size head of every request, SERVER_NEW_GAME and SERVER_BATCH are followed by their payload
+typedef struct
+{
+    uint8_t type;
+    uint8_t dir; // direction of SERVER_MOVE
+    uint8_t count; // amount of direction bytes after a SERVER_BATCH head
+    uint8_t reserved;
+    uint32_t session;
+}
+server_request_t;
+
+// response to every request, carries the state of the game after it was handled
+typedef struct
+{
+    uint8_t type; // type of the request answered
+    uint8_t status;
+    uint8_t moved; // amount of moves that changed the board (0 or 1 for SERVER_MOVE)
+    uint8_t running; // 1 if the game can still move, otherwise 0
+    uint32_t session;
+    board_t board; // packed bitboard of the game
+    uint32_t points;
+    uint32_t highest_tile;
+}
+server_response_t;
+
 // struct that holds the status of the game and other important features
 typedef struct game
 {
-    int **board; // 4x4 board with surrounding edges
+    board_t bitboard; // packed board that all moves, spawns and game-over checks run on (4x4 games only, 0 otherwise)
+    rng_t rng; // random number generator used for every random tile of this game
+    rng_t policy_rng; // random number generator for policies, kept apart so replays only need the tile stream
+    uint8_t line_moves[4]; // per direction, bit i is set when row/col i can move that way
+    int **board; // board with surrounding edges, kept in sync with bitboard for printing/cell access on 4x4 games
+    int size; // amount of tiles on each side of the board, 4x4 games run on the bitboard and others on board
     int points; // points earned during the game
     int highest_tile; // value of the biggest # tile the user has obtained
     int game_status; // status of the game (constants defined above)
@@ -67,26 +373,100 @@ typedef struct game
 }
 game_t;
 
+// all storage of one game in a single contiguous block: the struct, its padded board and its empty list
+typedef struct
+{
+    game_t game; // first field, so a game_t pointer is also a pointer to its block
+    int *rows[MAX_BOARD_LENGTH]; // row pointers of game.board
+    int cells[MAX_BOARD_LENGTH * MAX_BOARD_LENGTH]; // cells of the padded board, rows are size + 2 cells apart
+    empty_list_t empty_list;
+}
+game_block_t;
+
+// structure-of-arrays state of many 4x4 boards played in lockstep, all arrays live in the same allocation
+typedef struct
+{
+    int count; // amount of boards
+    board_t *boards; // board of each game
+    uint64_t *rng[4]; // xoshiro256** state of each board's spawns, word k of board i is rng[k][i]
+    int32_t *points; // points gained by each board's last move
+    uint8_t *dirs; // direction each board moves in on the next step, set by the caller
+    uint8_t *moved; // 1 if the board's last move changed it, otherwise 0
+    uint8_t *running; // 1 if the board still has a legal move, otherwise 0
+}
+board_batch_t;
+
+// pool of threads that run batches of work together with the calling thread (see 2048_pool.c)
+#define MAX_POOL_THREADS 64 // most threads one batch runs on, the calling thread included
+typedef struct thread_pool thread_pool_t;
+typedef void (*pool_work_t)(void *arg, int worker); // work of a batch, worker is 0 on the calling thread
+
+// preallocated games for batch use, acquiring and releasing never allocates
+typedef struct
+{
+    game_block_t *blocks; // every game of the pool in one contiguous array
+    game_t **free_games; // stack of games that are not in use
+    int capacity; // amount of games in the pool
+    int free_count; // amount of games on the free stack
+}
+game_pool_t;
+
+// FUNCTIONS FOR RANDOM NUMBERS
+void rng_seed(rng_t *rng, uint64_t seed); // seeds the generator, same seed always gives the same numbers
+uint64_t rng_next(rng_t *rng); // returns the next 64 random bits
+int rng_range(rng_t *rng, int bound); // returns a random number in [0, bound)
+uint64_t rng_mix_seed(uint64_t seed, uint64_t index); // derives an unrelated seed for each index from one base seed
+
+// FUNCTIONS FOR TIMING
+long long now_ns(); // returns the current time in nanoseconds from a monotonic clock, divide by 1e9 for seconds
+
 // FUNCTIONS FOR LIST (not involving game)
 empty_list_t *empty_list_init(); // allocates a list to be used in game_t struct
 void empty_list_free(empty_list_t *list); // frees list struct after allocation
+void empty_list_reset(empty_list_t *list); // removes every location from the list without freeing it
 void empty_list_add(empty_list_t *list, int row, int col); // adds set of row-col coordinates to the list
 int empty_list_remove(empty_list_t *list, int row, int col); // removes set of row-col coordinates to the list
 int empty_list_contains(empty_list_t *list, int row, int col); // checks if parameter row-col coordinates are in list
-int empty_list_get_random(empty_list_t *list, int *rowP, int *colP); // gets random set of coordinates from the list
+int empty_list_get_random(empty_list_t *list, rng_t *rng, int *rowP, int *colP); // gets random set of coordinates from the list
 void empty_list_print(empty_list_t *list); // prints contents of list, for debugging
 
 // FUNCTIONS FOR GAME INIT AND FREE
-game_t *game_init(); // initializes game struct and fields, initializes empty list
-int **board_init(); // initializes a board with either EMPTY or EDGE tiles
-int is_edge(int row, int col); // checks if a location on the board is supposed to be an edge
+game_t *game_init(int size); // allocates a size x size game (one allocation for everything), NULL for unsupported sizes
+game_t *game_setup(game_block_t *block, int size); // initializes a size x size game inside caller-provided storage
+void game_reset(game_t *game); // reinitializes a game in place for a new game, no allocations
+void game_seed(game_t *game, uint64_t seed); // reseeds the game's random number generator for a reproducible game
+int **board_init(int **rows, int *cells, int size); // initializes a padded size x size board in the given storage
+int is_edge(int size, int row, int col); // checks if a location on a padded size x size board is an edge
 void empty_list_add_all(game_t *game); // adds all spaces in the game to the game struct's empty list
 void game_free(game_t *game); // frees game struct and all fields + frees list
-void board_free(game_t *game); // frees board associated with game
 void game_print(game_t *game, int logging); // prints contents of game in its current state
+void game_pack_board(game_t *game); // copies the padded int board into the bitboard (after editing cells directly)
+void game_unpack_board(game_t *game); // copies the bitboard into the padded int board and updates the empty list
+void game_set_bitboard(game_t *game, board_t bitboard); // replaces the bitboard, updates move legality and the int board
+
+// FUNCTIONS FOR UNDO/REDO HISTORY
+void game_snapshot(game_t *game, game_snapshot_t *snapshot); // records the tiles, points and rng of the game
+void game_restore(game_t *game, game_snapshot_t *snapshot); // puts the game back to a snapshot, rebuilding the empty list
+game_history_t *history_init(); // allocates an empty history (one allocation)
+void history_free(game_history_t *history);
+void history_reset(game_history_t *history, game_t *game); // forgets every turn, the game becomes turn 0
+void history_record(game_history_t *history, game_t *game); // records a new turn, turns that could be redone are dropped
+int history_undo(game_history_t *history, game_t *game); // goes back one turn, returns 0 if there is none
+int history_redo(game_history_t *history, game_t *game); // goes forward one undone turn, returns 0 if there is none
+
+// FUNCTIONS FOR GAME POOLS
+game_pool_t *game_pool_init(int count, int size); // preallocates count size x size games in one contiguous block
+void game_pool_free(game_pool_t *pool); // frees the pool and all of its games
+game_t *game_pool_acquire(game_pool_t *pool); // takes a reset game from the pool, NULL if none are free
+void game_pool_release(game_pool_t *pool, game_t *game); // gives a game back to the pool
+
+// FUNCTIONS FOR THREAD POOLS
+thread_pool_t *thread_pool_init(); // allocates a pool without threads, it lives until the program exits
+void thread_pool_grow(thread_pool_t *pool, int threads); // starts pool threads until batches can run on threads threads
+void thread_pool_run(thread_pool_t *pool, int threads, pool_work_t work, void *arg); // runs work on the caller and threads - 1 pool threads
 
 // FUNCTIONS FOR ADDING RANDOM TILES
-int pick_random_tile(); // randomly picks between either 2 or 4 to add to the board
+int pick_random_tile(rng_t *rng); // randomly picks between either 2 or 4 to add to the board
 void place_random_tile(game_t *game); // places tile 2 or 4 at random place on the board that is empty
 
 // FUNCTIONS FOR MOVING TILES 
@@ -95,7 +475,8 @@ void move_col_north(game_t *game, int col);
 void move_col_south(game_t *game, int col);
 void move_row_east(game_t *game, int row);
 void move_row_west(game_t *game, int row);
-void move_all(game_t *game, int dir); // moves all rows/cols in direction given in parameter
+int move_all(game_t *game, int dir); // moves all rows/cols in direction given in parameter, returns 1 if the board changed
+int game_preview_move(game_t *game, int dir, int *points); // returns 1 if dir changes the board, adds its points, board untouched
 
 // FUNCTIONS FOR UPDATING BOARD
 void swap_tiles(game_t *game, int row1, int col1, int row2, int col2); // swaps the board location of two tiles
@@ -104,6 +485,179 @@ int combine_tiles(game_t *game, int row1, int col1, int row2, int col2, int chec
 // FUNCTIONS FOR CHECKING IF THE GAME HAS ENDED
 int game_running(game_t *game); // checks if game is done by checking empty list status and surrounding tiles
 int check_surrounding_tiles(game_t *game, int row, int col); // checks if surrounding tiles of this tile allow combine
+int game_legal_moves(game_t *game); // returns mask with bit dir set for every direction that changes the board, O(1)
+int game_can_move(game_t *game, int dir); // returns 1 if moving in dir changes the board, O(1)
+
+// FUNCTIONS FOR THE SUCCESSOR CACHE (lock-free, shared by every thread)
+board_t bitboard_move_cached(board_t board, int dir, int *points, int *movedP); // bitboard_move() through the cache, sets *movedP
+void move_cache_flush_stats(); // adds the calling thread's hit/miss counts to the shared totals
+void move_cache_stats(long *hitsP, long *missesP); // returns flushed hit/miss counts plus the calling thread's
+void move_cache_clear(); // empties the cache and resets the counters
+
+// FUNCTIONS FOR BOARDS OF ANY SIZE (kernels specialized for every size, used by games that are not 4x4)
+int grid_move(game_t *game, int dir, int apply, int *points); // moves the padded board if apply is set, returns 1 if it changed
+int grid_move_line(game_t *game, int index, int dir, int *points); // moves one row (EAST/WEST) or col (NORTH/SOUTH)
+void grid_update_line_moves(game_t *game); // recomputes the per-line move legality of the padded board
+
+// FUNCTIONS FOR THE PACKED BITBOARD (rows/cols are 0-indexed, values are tile values not exponents)
+int bitboard_get_tile(board_t board, int row, int col); // returns tile value at row-col, EMPTY if no tile
+board_t bitboard_set_tile(board_t board, int row, int col, int value); // returns board with value placed at row-col
+int bitboard_count_empty(board_t board); // returns amount of empty cells on the board
+uint16_t bitboard_empty_mask(board_t board); // returns mask with bit (row * 4 + col) set for every empty cell
+int bitboard_highest_tile(board_t board); // returns value of the biggest tile on the board
+board_t bitboard_transpose(board_t board); // swaps rows with columns so col moves can reuse row moves
+void bitboard_init_tables(); // builds the west/east row transition tables and picks the move kernel, thread safe
+void bitboard_row_tables(const row_move_t **westP, const row_move_t **eastP); // returns the tables, for kernels doing their own lookups
+uint16_t bitboard_reverse_row(uint16_t row); // mirrors one packed row so east moves can reuse west moves
+uint16_t bitboard_move_row_west(uint16_t row, int *points); // slides + merges one packed row towards col 0
+uint16_t bitboard_move_row_east(uint16_t row, int *points); // slides + merges one packed row towards col 3
+board_t bitboard_move(board_t board, int dir, int *points); // moves all rows/cols, adds points gained to *points
+board_t bitboard_move_line(board_t board, int index, int dir, int *points); // moves one row (EAST/WEST) or col (NORTH/SOUTH)
+int bitboard_running(board_t board); // returns 1 if any move is still possible, otherwise 0
+board_t bitboard_place_random_tile(board_t board, rng_t *rng); // returns board with a 2 or 4 placed on a random empty cell
+uint8_t bitboard_line_moves(board_t board, int dir); // returns mask of the rows/cols that can move in dir
+void bitboard_update_line_moves(board_t old_board, board_t board, uint8_t line_moves[4]); // refreshes changed lines only
+int bitboard_legal_moves(board_t board); // returns mask with bit dir set for every direction that changes the board
+void bitboard_print(board_t board); // prints packed board, for debugging
+
+// FUNCTIONS FOR BATCHES OF BOARDS (structure of arrays, see 2048_batch.c)
+board_batch_t *board_batch_init(int count); // allocates count empty, unseeded boards in one allocation
+void board_batch_free(board_batch_t *batch);
+void board_batch_seed(board_batch_t *batch, int index, uint64_t seed); // seeds one board's spawns like rng_seed()
+void board_batch_step(board_batch_t *batch); // moves every board in its dir, spawns where moved, refreshes running
+void batch_move(const board_t *boards, const uint8_t *dirs, board_t *results, int32_t *points, uint8_t *moved, int count);
+void batch_spawn(board_t *boards, uint64_t *rng[4], const uint8_t *mask, int count); // spawns where mask is set, e.g. the moved flags
+void batch_running(const board_t *boards, uint8_t *running, int count); // game-over check of every board
+
+// FUNCTIONS FOR WHOLE-BOARD MOVE KERNELS (SSE4.1/AVX2 picked at runtime, scalar fallback)
+void bitboard_init_kernels(); // picks the best kernel for this CPU, run once by bitboard_init_tables()
+board_t bitboard_move_board(board_t board, int dir, int *points, uint8_t *changedP); // bitboard_move() in one kernel, sets changed lines
+char *bitboard_kernel_name(); // returns the name of the kernel picked for this CPU ("avx2", "sse4" or "scalar")
+int bitboard_use_kernel(char *name); // forces a kernel by name, returns 0 if this CPU cannot run it
+
+// FUNCTIONS FOR BOARD SYMMETRIES (the 8 rotations and mirrors of a packed 4x4 board)
+board_t bitboard_transform(board_t board, int transform); // applies a transform (0 to 7) to a board
+int symmetry_inverse(int transform); // returns the transform that undoes the given one
+int symmetry_map_dir(int dir, int transform); // returns the direction that moves the transformed board like dir moves the original
+board_t bitboard_canonical(board_t board, int *transformP); // returns the smallest symmetry of a board and the transform giving it
+uint64_t bitboard_symmetric_hash(board_t board); // hash shared by all 8 symmetries of a board
+board_t bitboard_move_canonical(board_t board, int dir, int *points, int *movedP); // bitboard_move_board() made on the canonical board and mapped back
+
+// move policies pick the next direction (NORTH, SOUTH, EAST, WEST) for a running game
+typedef int (*move_policy_t)(game_t *game);
+
+// FUNCTIONS FOR MOVE POLICIES (used by headless simulations and AI play)
+int policy_random(game_t *game); // picks a random direction among the ones that change the board
+int policy_corner_greedy(game_t *game); // picks the direction with the most points, ties keep tiles in the bottom-left corner
+int policy_expectimax(game_t *game); // picks the direction suggested by the expectimax search
+int policy_rollout(game_t *game); // picks the direction suggested by the Monte Carlo rollout player
+int policy_ntuple(game_t *game); // picks the direction the n-tuple network values most, corner-greedy without weights
+move_policy_t policy_by_name(char *name); // returns the policy with the given name, NULL if there is none
+
+// FUNCTIONS FOR AI (expectimax search over the bitboard)
+void ai_set_time_budget(int milliseconds); // sets how long suggest_move() may search for each move
+void ai_set_threads(int threads); // sets how many threads suggest_move() splits the root of its search between
+int suggest_move(game_t *game); // returns the direction the expectimax search considers best
+
+// FUNCTIONS FOR ROLLOUT PLAYER (random playouts over the bitboard)
+#define ROLLOUT_DEFAULT_PLAYOUTS 256 // playouts per direction of each move unless a budget is set
+void rollout_set_budget(int playouts, int milliseconds); // sets the playouts per direction and time of each move, 0 for no limit
+void rollout_set_threads(int threads); // sets how many threads rollout_suggest_move() plays on
+int rollout_suggest_move(game_t *game); // returns the direction whose random playouts score the most points on average
+void rollout_stats(long *playoutsP, double *secondsP); // returns the playouts run and seconds spent on moves so far
+
+// FUNCTIONS FOR N-TUPLE NETWORKS (board values learned by temporal difference self-play)
+ntuple_net_t *ntuple_create(); // allocates a network with every weight 0
+ntuple_net_t *ntuple_open(char *path, int writable); // maps a weights file (writable mappings are private), NULL if it is malformed
+int ntuple_save(ntuple_net_t *net, char *path); // writes the weights through a temporary file and a rename, returns 1 on success
+void ntuple_free(ntuple_net_t *net); // frees or unmaps a network
+float ntuple_value(ntuple_net_t *net, board_t board); // sums the weights of every tuple in all 8 symmetries of the board
+void ntuple_update(ntuple_net_t *net, board_t board, float delta); // adds delta to the value of the board, split over its weights
+int ntuple_best_move(ntuple_net_t *net, board_t board, board_t *afterP, float *scoreP, float *valueP); // direction with the best points + value after it, -1 if none
+int ntuple_use_weights(char *path); // maps the weights policy_ntuple() plays with, returns 0 if the file cannot be used
+
+// FUNCTIONS FOR EVALUATING BOARDS (heuristic terms precomputed per packed row)
+void eval_init_tables(); // builds the row score table from the current weights, safe to call more than once
+int eval_load_weights(char *path); // loads "name value" weights from a config file and rebuilds the table
+eval_weights_t eval_get_weights(); // returns the weights currently used
+float eval_board(board_t board); // scores a board with 8 table lookups, bigger is better
+float eval_game(game_t *game); // scores the board of a game
+
+// FUNCTIONS FOR GAME LOGS AND REPLAYS
+game_log_t *game_log_init(uint64_t seed, int record_spawns); // allocates an empty log for a game with the given seed
+void game_log_free(game_log_t *log); // frees a log
+void game_log_add_move(game_log_t *log, int dir); // appends a move to the log
+int game_log_move(game_log_t *log, uint32_t turn); // returns the move made at the given turn
+void game_log_add_spawn(game_log_t *log, board_t before, board_t after); // appends the tile that appeared, if spawns are recorded
+void game_log_finish(game_log_t *log, game_t *game); // records final points and highest tile for verification
+int game_log_write(game_log_t *log, FILE *file); // appends the log to a file, returns 1 on success
+game_log_t *game_log_read(FILE *file); // reads the next log from a file, NULL at the end or on a malformed log
+long play_logged_game(game_t *game, move_policy_t policy, game_log_t *log); // plays a whole game while recording it
+long replay_to_turn(game_log_t *log, game_t *game, uint32_t turn); // fast-forwards a log to a turn, -1 on spawn mismatch
+int replay_verify(game_log_t *log, game_t *game); // replays a whole log, returns 1 if it matches the recorded result
+
+// FUNCTIONS FOR DATASETS OF SIMULATED MOVES
+dataset_file_t *dataset_file_create(char *path); // creates (or truncates) a dataset file, NULL on failure
+int dataset_file_close(dataset_file_t *file); // writes the header and closes the file, returns 1 on success
+dataset_writer_t *dataset_writer_init(dataset_file_t *file); // allocates a writer with an empty block
+void dataset_writer_add(dataset_writer_t *writer, board_t board, int dir, int reward, int terminal); // appends one row
+void dataset_writer_flush(dataset_writer_t *writer); // writes the block even if it is not full
+void dataset_writer_free(dataset_writer_t *writer); // flushes and frees a writer
+dataset_t *dataset_open(char *path); // maps a dataset file read-only, NULL if it cannot be mapped or is malformed
+void dataset_close(dataset_t *dataset); // unmaps a dataset
+uint64_t dataset_row_count(dataset_t *dataset); // returns the amount of rows in the dataset
+int dataset_row(dataset_t *dataset, uint64_t index, board_t *boardP, int *dirP, int *rewardP, int *terminalP); // reads one row, 0 if out of range
+
+// FUNCTIONS FOR RENDERING IN PLACE WITH ANSI ESCAPES
+void render_init(renderer_t *renderer, char *header, int fps); // sets up a renderer, fps 0 renders every frame
+void render_invalidate(renderer_t *renderer); // forces the next frame to clear the screen and repaint everything
+void render_message(renderer_t *renderer, char *message); // sets the status line shown under the board
+int render_frame(renderer_t *renderer, game_t *game, int force); // draws what changed, returns 0 if the fps cap skipped it
+
+// phases of the hot path measured by the instrumentation
+#define PHASE_MOVE_ALL          0
+#define PHASE_SWAP_TILES        1
+#define PHASE_COMBINE_TILES     2
+#define PHASE_PLACE_RANDOM_TILE 3
+#define PHASE_GAME_RUNNING      4
+#define PHASE_GAME_PRINT        5
+#define PHASE_COUNT             6
+
+/*
+    Instrumentation is compiled in only when INSTRUMENT is defined ("make INSTRUMENT=1"),
+    otherwise INSTRUMENT_PHASE() expands to nothing and costs nothing
+
+    INSTRUMENT_PHASE(phase) at the top of a function counts the call and times it (in cycles)
+    until the function returns, through any of its return statements
+*/
+#ifdef INSTRUMENT
+typedef struct
+{
+    int phase;
+    uint64_t start; // cycle counter when the phase began
+    long allocs; // allocations the thread had made when the phase began
+}
+phase_timer_t;
+
+extern __thread long instrument_thread_allocs; // allocations made by the calling thread, counted by the wrapped allocator
+phase_timer_t instrument_begin(int phase); // starts timing a phase
+void instrument_end(phase_timer_t *timer); // adds the time and allocations since instrument_begin() to the phase
+#define INSTRUMENT_PHASE(phase) \
+    phase_timer_t phase_timer __attribute__((cleanup(instrument_end))) = instrument_begin(phase)
+#else
+#define INSTRUMENT_PHASE(phase)
+#endif
+
+// FUNCTIONS FOR INSTRUMENTATION (print a note instead of counters in builds without INSTRUMENT)
+void instrument_dump(int fd); // writes the call count, total/mean/max cycles and allocations of every phase
+void instrument_reset(); // sets every counter back to 0
 
 // FUNCTIONS FOR SETTING CONDITIONS FOR PLAY WITHOUT NEEDING TO PRESS ENTER
-void set_terminal(struct termios old, struct termios new);
\ No newline at end of file
+void set_terminal(struct termios *old); // raw key input, old settings are saved in *old and restored on exit/signals
+void restore_terminal(); // puts the terminal back the way it was before set_terminal()
+
+// FUNCTIONS FOR NON-BLOCKING INPUT
+int input_read_keys(key_queue_t *queue, int timeout_ms); // drains pending keys into the queue, -1 at end of input
+int key_queue_pop(key_queue_t *queue); // returns the oldest queued key, -1 if the queue is empty
+void key_queue_clear(key_queue_t *queue); // drops every queued key
+int key_to_dir(int key); // returns the direction of a W/A/S/D key, -1 for any other key
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "2048.h"
+#include <stdatomic.h>
+
+/*
+    Expectimax search over packed bitboards
+
+    Max nodes try the four directions, chance nodes average over every empty cell
+    receiving a STANDARD (90%) or SPECIAL (10%) tile, same odds as pick_random_tile().
+
+    Search depth adapts to the board (more distinct tiles means deeper search), branches
+    whose probability falls below CPROB_THRESHOLD are cut off, and suggest_move() deepens
+    iteratively until the per-move time budget runs out.
+
+    With more than one AI thread, every (root move, spawn cell, spawn tile) branch of a depth
+    becomes a task for a thread pool, and all workers share one lockless transposition table.
+*/
+
+#define TT_BITS         20      // transposition table holds 2^TT_BITS entries (16 MB) per thread
+#define TT_SIZE         (1 << TT_BITS)
+#define CPROB_THRESHOLD 0.0001f // chance branches less likely than this are evaluated instead of searched
+#define MAX_SEARCH_DEPTH 12     // hard cap on the iterative deepening
+#define TIME_CHECK_NODES 4096   // amount of nodes searched between clock checks
+#define LOST_SCORE      -1e9f   // score of a board where no move is possible
+#define MAX_ROOT_TASKS  (4 * BITBOARD_LENGTH * BITBOARD_LENGTH * 2) // every root move, spawn cell and spawn tile
+
+/*
+    one cached search result, safe to share between threads without locks
+
+    data packs the score (low 32 bits) and depth (high 32 bits), key is board ^ data;
+    a reader only trusts the entry if key ^ data gives back its board, so an entry
+    torn by two threads writing at once is treated as a miss instead of a wrong score
+*/
+typedef struct
+{
+    _Atomic uint64_t key;
+    _Atomic uint64_t data;
+}
+tt_entry_t;
+
+// state of one search, shared by every thread working on it
+typedef struct
+{
+    tt_entry_t *table; // transposition table, allocated the first time the search runs
+    double deadline; // time (seconds) after which the search is abandoned
+    atomic_int timed_out; // set once the deadline passes, results of the current depth are thrown away
+}
+search_t;
+
+// one (root move, spawn) branch of the root, searched by whichever pool thread takes it
+typedef struct
+{
+    board_t board; // board after the root move and the spawn
+    int dir; // root move the branch belongs to
+    float weight; // probability of the spawn (tile odds divided by the amount of empty cells)
+    float score; // expected score found by the search
+}
+root_task_t;
+
+// root of a parallel search, split between the threads of the pool
+typedef struct
+{
+    root_task_t tasks[MAX_ROOT_TASKS];
+    int task_count;
+    atomic_int next_task; // index of the next task to be taken
+    int depth; // depth every task of the batch is searched to
+}
+search_root_t;
+
+// serial searches give each thread its own table so simulations can use expectimax on all cores
+static __thread search_t local_search;
+
+// parallel searches share one table between all pool threads
+static search_t shared_search;
+static search_root_t root;
+static thread_pool_t *pool = NULL;
+
+// amount of nodes this thread searched since its last clock check
+static __thread long nodes;
+
+// per-move time budget in milliseconds
+static int time_budget_ms = 100;
+
+// amount of threads suggest_move() searches with
+static int ai_threads = 1;
+
+// hashes a board into an index of the transposition table
+static uint32_t tt_index(board_t board)
+{
+    return (uint32_t)((board * 0x9E3779B97F4A7C15ULL) >> (64 - TT_BITS));
+}
+
+// sets the time budget of each move suggested by suggest_move()
+void ai_set_time_budget(int milliseconds)
+{
+    time_budget_ms = milliseconds;
+}
+
+// returns the cached score of board if it was searched at least as deep, otherwise returns 0
+static int tt_lookup(search_t *search, board_t board, int depth, float *scoreP)
+{
+    tt_entry_t *entry = &search->table[tt_index(board)];
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+    if((key ^ data) != board || (int)(data >> 32) < depth)
+    {
+        return 0;
+    }
+    uint32_t bits = (uint32_t)data;
+    memcpy(scoreP, &bits, sizeof(float));
+    return 1;
+}
+
+// caches the score of board, replacing whatever was in its slot
+static void tt_store(search_t *search, board_t board, int depth, float score)
+{
+    tt_entry_t *entry = &search->table[tt_index(board)];
+    uint32_t bits;
+    memcpy(&bits, &score, sizeof(float));
+    uint64_t data = ((uint64_t)depth << 32) | bits;
+    atomic_store_explicit(&entry->key, board ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+// returns amount of different tile values on the board, used to pick the search depth
+static int count_distinct_tiles(board_t board)
+{
+    uint16_t seen = 0;
+    for(int cell = 0; cell < BITBOARD_LENGTH * BITBOARD_LENGTH; cell++)
+    {
+        seen |= 1 << ((board >> (cell * CELL_BITS)) & CELL_MASK);
+    }
+    return __builtin_popcount(seen >> 1); // bit 0 is EMPTY
+}
+
+static float search_chance(search_t *search, board_t board, int depth, float cprob);
+
+// max node: best expected score over the four directions, LOST_SCORE if none of them changes the board
+static float search_max(search_t *search, board_t board, int depth, float cprob)
+{
+    if((++nodes % TIME_CHECK_NODES) == 0 && now_ns() / 1e9 > search->deadline)
+    {
+        atomic_store(&search->timed_out, 1);
+    }
+    if(atomic_load_explicit(&search->timed_out, memory_order_relaxed))
+    {
+        return 0.0f;
+    }
+    float best;
+    if(tt_lookup(search, board, depth, &best))
+    {
+        return best;
+    }
+    best = LOST_SCORE;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        int points = 0;
+        uint8_t changed;
+        board_t moved = bitboard_move_board(board, dir, &points, &changed);
+        if(!changed)
+        {
+            continue;
+        }
+        float score = search_chance(search, moved, depth, cprob);
+        if(score > best)
+        {
+            best = score;
+        }
+    }
+    if(atomic_load_explicit(&search->timed_out, memory_order_relaxed)) // score is incomplete, do not cache it
+    {
+        return 0.0f;
+    }
+    tt_store(search, board, depth, best);
+    return best;
+}
+
+// chance node: average over every empty cell receiving a 2 (90%) or a 4 (10%)
+static float search_chance(search_t *search, board_t board, int depth, float cprob)
+{
+    if(depth <= 0 || cprob < CPROB_THRESHOLD)
+    {
+        return eval_board(board);
+    }
+    uint16_t empty = bitboard_empty_mask(board);
+    int count = __builtin_popcount(empty);
+    float total = 0.0f;
+    while(empty)
+    {
+        int cell = __builtin_ctz(empty);
+        empty &= empty - 1;
+        board_t two = board | ((board_t)1 << (cell * CELL_BITS));
+        board_t four = board | ((board_t)2 << (cell * CELL_BITS));
+        total += 0.9f * search_max(search, two, depth - 1, cprob * 0.9f / count);
+        total += 0.1f * search_max(search, four, depth - 1, cprob * 0.1f / count);
+    }
+    return total / count;
+}
+
+/*
+    Searches every direction from the root to the given depth on the calling thread
+    Returns the best direction, or -1 if the search ran out of time before finishing
+*/
+static int search_root(search_t *search, board_t board, int depth)
+{
+    int best_dir = -1;
+    float best = LOST_SCORE - 1.0f;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        int points = 0;
+        uint8_t changed;
+        board_t moved = bitboard_move_board(board, dir, &points, &changed);
+        if(!changed)
+        {
+            continue;
+        }
+        float score = search_chance(search, moved, depth, 1.0f);
+        if(atomic_load(&search->timed_out))
+        {
+            return -1;
+        }
+        if(score > best)
+        {
+            best = score;
+            best_dir = dir;
+        }
+    }
+    return best_dir;
+}
+
+// work of every thread of the pool: takes tasks of the root until none are left
+static void run_root_tasks(void *arg, int worker)
+{
+    search_root_t *batch = arg;
+    int index;
+    while((index = atomic_fetch_add(&batch->next_task, 1)) < batch->task_count)
+    {
+        root_task_t *task = &batch->tasks[index];
+        task->score = search_max(&shared_search, task->board, batch->depth - 1, task->weight);
+    }
+}
+
+/*
+    Sets the amount of threads suggest_move() searches with (1 searches on the calling thread only)
+    Pool threads are started once and sleep between moves, lowering the amount leaves the extra ones asleep
+*/
+void ai_set_threads(int threads)
+{
+    if(threads < 1)
+    {
+        threads = 1;
+    }
+    if(threads > MAX_POOL_THREADS)
+    {
+        threads = MAX_POOL_THREADS;
+    }
+    if(threads > 1)
+    {
+        if(pool == NULL)
+        {
+            pool = thread_pool_init();
+        }
+        thread_pool_grow(pool, threads);
+    }
+    ai_threads = threads;
+}
+
+/*
+    Searches every direction from the root to the given depth on the whole pool
+    Each root move is split into one task per spawn cell and spawn tile, the calling thread works too
+
+    Returns the best direction, or -1 if the search ran out of time before finishing
+*/
+static int search_root_parallel(board_t board, int depth)
+{
+    root.task_count = 0;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        int points = 0;
+        uint8_t changed;
+        board_t moved = bitboard_move_board(board, dir, &points, &changed);
+        if(!changed)
+        {
+            continue;
+        }
+        uint16_t empty = bitboard_empty_mask(moved);
+        int count = __builtin_popcount(empty);
+        while(empty)
+        {
+            int cell = __builtin_ctz(empty);
+            empty &= empty - 1;
+            root.tasks[root.task_count++] = (root_task_t){moved | ((board_t)1 << (cell * CELL_BITS)), dir, 0.9f / count, 0.0f};
+            root.tasks[root.task_count++] = (root_task_t){moved | ((board_t)2 << (cell * CELL_BITS)), dir, 0.1f / count, 0.0f};
+        }
+    }
+    root.depth = depth;
+    atomic_store(&root.next_task, 0);
+
+    thread_pool_run(pool, ai_threads, run_root_tasks, &root); // the calling thread takes tasks too
+
+    if(atomic_load(&shared_search.timed_out))
+    {
+        return -1;
+    }
+    // the expected score of a root move is the weighted sum of its spawn branches
+    float dir_scores[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int dir_legal[4] = {0, 0, 0, 0};
+    for(int index = 0; index < root.task_count; index++)
+    {
+        dir_scores[root.tasks[index].dir] += root.tasks[index].weight * root.tasks[index].score;
+        dir_legal[root.tasks[index].dir] = 1;
+    }
+    int best_dir = -1;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        if(dir_legal[dir] && (best_dir < 0 || dir_scores[dir] > dir_scores[best_dir]))
+        {
+            best_dir = dir;
+        }
+    }
+    return best_dir;
+}
+
+/*
+    Suggests the next move for the game with expectimax search
+    Deepens one level at a time, up to a depth based on the amount of distinct tiles,
+    and returns the best direction of the deepest search finished within the time budget
+*/
+int suggest_move(game_t *game)
+{
+    eval_init_tables(); // only built on the first call
+    int parallel = ai_threads > 1;
+    search_t *search = parallel ? &shared_search : &local_search;
+    if(search->table == NULL)
+    {
+        search->table = calloc(TT_SIZE, sizeof(tt_entry_t));
+    }
+    board_t board = game->bitboard;
+    int max_depth = count_distinct_tiles(board) - 2;
+    if(max_depth < 3)
+    {
+        max_depth = 3;
+    }
+    if(max_depth > MAX_SEARCH_DEPTH)
+    {
+        max_depth = MAX_SEARCH_DEPTH;
+    }
+    atomic_store(&search->timed_out, 0);
+    search->deadline = now_ns() / 1e9 + time_budget_ms / 1000.0;
+    int best_dir = policy_corner_greedy(game); // fallback if not even depth 1 finishes in time
+    for(int depth = 1; depth <= max_depth; depth++)
+    {
+        int dir = parallel ? search_root_parallel(board, depth) : search_root(search, board, depth);
+        if(dir < 0) // ran out of time, keep the result of the previous depth
+        {
+            break;
+        }
+        best_dir = dir;
+    }
+    return best_dir;
+}
+
+// move policy wrapper so expectimax can be used by the simulation driver
+int policy_expectimax(game_t *game)
+{
+    if(game->size != BITBOARD_LENGTH) // the search runs on packed 4x4 bitboards only
+    {
+        return policy_corner_greedy(game);
+    }
+    return suggest_move(game);
+}
@@ -0,0 +1,205 @@
+#include "2048.h"
+
+/*
+    Structure-of-arrays batch API for 4x4 boards advanced in lockstep
+
+    Callers that play thousands of independent games (simulation, training) keep every
+    game as one slot of plain arrays: boards, directions, points, moved and running flags,
+    and the four words of each board's xoshiro256** state in four separate arrays. Each
+    kernel below is one loop over those arrays with no branches on the data, so the compiler
+    can vectorize it (this file is built with -O3, and target_clones adds an AVX2 build of
+    every kernel that is picked at runtime on CPUs that have it).
+
+    Spawns draw from each board's generator exactly the way bitboard_place_random_tile()
+    does, so a board seeded like a game's rng gets the same tiles in a batch as in a game.
+*/
+
+#define BATCH_KERNEL __attribute__((target_clones("avx2", "default")))
+
+// same bit trick as bitboard_transpose(), inline so the passes below stay branch-free loops
+static inline board_t batch_transpose(board_t board)
+{
+    board_t a1 = board & 0xF0F00F0FF0F00F0FULL;
+    board_t a2 = board & 0x0000F0F00000F0F0ULL;
+    board_t a3 = board & 0x0F0F00000F0F0000ULL;
+    board_t a = a1 | (a2 << 12) | (a3 >> 12);
+    board_t b1 = a & 0xFF00FF0000FF00FFULL;
+    board_t b2 = a & 0x00FF00FF00000000ULL;
+    board_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+// returns the board with bit 0 of every empty cell's nibble set
+static inline board_t batch_empty_cells(board_t board)
+{
+    return ~(board | (board >> 1) | (board >> 2) | (board >> 3)) & 0x1111111111111111ULL;
+}
+
+// returns the amount of empty cells, summed per byte instead of with popcount so it vectorizes
+static inline uint64_t batch_count_empty(board_t board)
+{
+    board_t empty = batch_empty_cells(board);
+    empty = (empty + (empty >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (empty * 0x0101010101010101ULL) >> 56;
+}
+
+static inline uint64_t batch_rotate_left(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/*
+    Moves every board in its direction, boards and results may be the same array
+    points[i] gets the points gained by board i and moved[i] is 1 if it changed, otherwise 0
+*/
+BATCH_KERNEL void batch_move(const board_t *boards, const uint8_t *dirs, board_t *results, int32_t *points,
+    uint8_t *moved, int count)
+{
+    const row_move_t *west, *east;
+    bitboard_row_tables(&west, &east);
+    // cols of NORTH/SOUTH boards become rows, selected with a mask instead of a branch
+    for(int index = 0; index < count; index++)
+    {
+        board_t cols = -(board_t)(dirs[index] <= SOUTH);
+        board_t board = boards[index];
+        results[index] = (batch_transpose(board) & cols) | (board & ~cols);
+    }
+    // every row is one table lookup, the only pass that cannot vectorize without gathers
+    for(int index = 0; index < count; index++)
+    {
+        const row_move_t *table = (dirs[index] == WEST || dirs[index] == NORTH) ? west : east;
+        board_t board = results[index];
+        board_t result = 0;
+        int gained = 0, changed = 0;
+        for(int row = 0; row < BITBOARD_LENGTH; row++)
+        {
+            const row_move_t *move = &table[(board >> (row * ROW_BITS)) & ROW_MASK];
+            result |= (board_t)move->row << (row * ROW_BITS);
+            gained += move->points;
+            changed |= move->changed;
+        }
+        results[index] = result;
+        points[index] = gained;
+        moved[index] = changed;
+    }
+    for(int index = 0; index < count; index++)
+    {
+        board_t cols = -(board_t)(dirs[index] <= SOUTH);
+        board_t board = results[index];
+        results[index] = (batch_transpose(board) & cols) | (board & ~cols);
+    }
+}
+
+/*
+    Spawn loop of batch_spawn(), the arrays never overlap and restrict tells the compiler so:
+    otherwise the loop needs more run-time overlap checks than the vectorizer is allowed to add
+*/
+BATCH_KERNEL static void spawn_boards(board_t *restrict boards, uint64_t *restrict s0, uint64_t *restrict s1,
+    uint64_t *restrict s2, uint64_t *restrict s3, const uint8_t *restrict mask, int count)
+{
+    for(int index = 0; index < count; index++)
+    {
+        board_t board = boards[index];
+        board_t empty = batch_empty_cells(board);
+        uint64_t empty_count = batch_count_empty(board);
+        uint64_t spawn = -(uint64_t)((mask[index] != 0) & (empty_count != 0));
+        // two xoshiro256** steps, the first picks the cell and the second the tile
+        uint64_t a = s0[index], b = s1[index], c = s2[index], d = s3[index];
+        uint64_t first = batch_rotate_left(b * 5, 7) * 9;
+        uint64_t t = b << 17;
+        c ^= a; d ^= b; b ^= c; a ^= d; c ^= t; d = batch_rotate_left(d, 45);
+        uint64_t second = batch_rotate_left(b * 5, 7) * 9;
+        t = b << 17;
+        c ^= a; d ^= b; b ^= c; a ^= d; c ^= t; d = batch_rotate_left(d, 45);
+        s0[index] = (a & spawn) | (s0[index] & ~spawn);
+        s1[index] = (b & spawn) | (s1[index] & ~spawn);
+        s2[index] = (c & spawn) | (s2[index] & ~spawn);
+        s3[index] = (d & spawn) | (s3[index] & ~spawn);
+        // same draws as rng_range(): the empty cell at that rank, and a 4 (exponent 2) one time in 10
+        uint64_t rank = ((first >> 32) * empty_count) >> 32;
+        uint64_t exponent = 1 + ((((second >> 32) * 10) >> 32) == SPECIAL);
+        board_t cell = 0;
+        uint64_t seen = 0;
+        for(int shift = 0; shift < 64; shift += CELL_BITS)
+        {
+            uint64_t bit = (empty >> shift) & 1;
+            cell |= (bit & (seen == rank)) << shift;
+            seen += bit;
+        }
+        boards[index] = board | (cell * exponent & spawn);
+    }
+}
+
+/*
+    Places a 2 or 4 on a random empty cell of every board whose mask slot is set (moved flags after a move)
+    rng[k][i] is word k of board i's generator, which only advances for boards that get a tile
+*/
+void batch_spawn(board_t *boards, uint64_t *rng[4], const uint8_t *mask, int count)
+{
+    spawn_boards(boards, rng[0], rng[1], rng[2], rng[3], mask, count);
+}
+
+// sets running[i] to 1 if board i has an empty cell or two equal neighbours that can merge, otherwise 0
+BATCH_KERNEL void batch_running(const board_t *boards, uint8_t *running, int count)
+{
+    for(int index = 0; index < count; index++)
+    {
+        board_t board = boards[index];
+        board_t across = board ^ (board >> CELL_BITS); // zero nibble where a cell equals its right neighbour
+        board_t down = board ^ (board >> ROW_BITS); // zero nibble where a cell equals the one below it
+        board_t merges = (batch_empty_cells(across) & 0x0111011101110111ULL) | (batch_empty_cells(down) & 0x0000111111111111ULL);
+        merges &= ~batch_empty_cells(~board); // two 32768s never merge, same as the row tables
+        running[index] = (batch_empty_cells(board) | merges) != 0;
+    }
+}
+
+// allocates a batch of count empty boards in one allocation, every board is running and unseeded
+board_batch_t *board_batch_init(int count)
+{
+    // 5 words per board for the board and its rng, a 6th holds points and the byte arrays
+    board_batch_t *batch = calloc(1, sizeof(board_batch_t) + (size_t)count * 6 * sizeof(uint64_t));
+    if(batch == NULL)
+    {
+        return NULL;
+    }
+    uint64_t *slots = (uint64_t *)(batch + 1);
+    batch->count = count;
+    batch->boards = slots;
+    for(int word = 0; word < 4; word++)
+    {
+        batch->rng[word] = slots + (size_t)count * (1 + word);
+    }
+    batch->points = (int32_t *)(slots + (size_t)count * 5);
+    batch->dirs = (uint8_t *)(batch->points + count);
+    batch->moved = batch->dirs + count;
+    batch->running = batch->moved + count;
+    memset(batch->running, 1, count);
+    return batch;
+}
+
+void board_batch_free(board_batch_t *batch)
+{
+    free(batch);
+}
+
+// seeds the spawn generator of board index the same way rng_seed() seeds a game's rng
+void board_batch_seed(board_batch_t *batch, int index, uint64_t seed)
+{
+    rng_t rng;
+    rng_seed(&rng, seed);
+    for(int word = 0; word < 4; word++)
+    {
+        batch->rng[word][index] = rng.s[word];
+    }
+}
+
+/*
+    Plays one turn of every board: moves each in its dirs slot, spawns a tile on the boards that moved
+    and refreshes the running flags; boards that are over are moved like any other and stay as they are
+*/
+void board_batch_step(board_batch_t *batch)
+{
+    batch_move(batch->boards, batch->dirs, batch->boards, batch->points, batch->moved, batch->count);
+    batch_spawn(batch->boards, batch->rng, batch->moved, batch->count);
+    batch_running(batch->boards, batch->running, batch->count);
+}
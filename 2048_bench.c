@@ -0,0 +1,493 @@
+#include "2048.h"
+
+/*
+    Microbenchmarks for the hot paths of the engine
+
+    Every benchmark runs SAMPLES batches of BATCH_OPS operations on a fixed set of
+    positions recorded from seeded random games, so runs are repeatable. Each batch is
+    timed on its own, giving ns/op percentiles, and malloc/calloc/free are wrapped at
+    link time (-Wl,--wrap=...) so allocations per operation are counted as well.
+
+    Results are printed as one JSON object per line.
+
+    usage: ./bench [seed] [filter]
+    only benchmarks whose name contains filter are run
+*/
+
+#define SAMPLES    101    // amount of timed batches per benchmark
+#define BATCH_OPS  1000   // amount of operations in each batch of the fast benchmarks
+#define GAME_OPS   10     // amount of whole games in each batch of the full game benchmark
+#define POSITIONS  4096   // amount of recorded positions the benchmarks cycle through
+#define LOCKSTEP_GAMES 1024 // amount of games advanced by each operation of the lockstep benchmarks
+#define LOCKSTEP_OPS   10   // amount of lockstep turns in each batch of those benchmarks
+
+#ifdef INSTRUMENT
+#define alloc_count instrument_thread_allocs // instrumented builds already wrap the allocator
+#else
+// counters updated by the allocator wrappers below
+long alloc_count = 0;
+long free_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void __real_free(void *pointer);
+
+void *__wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(count, size);
+}
+
+void __wrap_free(void *pointer)
+{
+    if(pointer != NULL)
+    {
+        free_count++;
+    }
+    __real_free(pointer);
+}
+#endif
+
+// positions recorded from random games, sparse ones have empty cells and full ones do not
+board_t sparse_boards[POSITIONS];
+board_t full_boards[POSITIONS];
+int full_count = 0;
+
+// game shared by the benchmarks that need one
+game_t *bench_game;
+
+// the same LOCKSTEP_GAMES games as one structure-of-arrays batch and as separate games
+board_batch_t *lockstep_batch;
+game_pool_t *lockstep_pool;
+game_t *lockstep_games[LOCKSTEP_GAMES];
+
+// sink that keeps the compiler from removing benchmarked work
+volatile uint64_t sink;
+
+// comparison function for sorting samples with qsort
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+    Times SAMPLES batches of batch_ops calls of op and prints the results as one JSON line
+    op gets the index of the operation so it can cycle through the recorded positions
+*/
+void run_bench(char *name, char *filter, void (*op)(int index), int batch_ops)
+{
+    if(filter != NULL && strstr(name, filter) == NULL)
+    {
+        return;
+    }
+    double samples[SAMPLES];
+    long allocs_before = alloc_count;
+    int index = 0;
+    for(int sample = 0; sample < SAMPLES; sample++)
+    {
+        long long start = now_ns();
+        for(int op_index = 0; op_index < batch_ops; op_index++)
+        {
+            op(index++);
+        }
+        samples[sample] = (double)(now_ns() - start) / batch_ops;
+    }
+    double allocs_per_op = (double)(alloc_count - allocs_before) / (SAMPLES * batch_ops);
+    double total = 0.0;
+    for(int sample = 0; sample < SAMPLES; sample++)
+    {
+        total += samples[sample];
+    }
+    qsort(samples, SAMPLES, sizeof(double), compare_doubles);
+    printf("{\"name\": \"%s\", \"ns_per_op\": %.2f, \"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, "
+        "\"max\": %.2f, \"allocs_per_op\": %.3f}\n", name, total / SAMPLES, samples[0], samples[SAMPLES / 2],
+        samples[SAMPLES * 9 / 10], samples[SAMPLES * 99 / 100], samples[SAMPLES - 1], allocs_per_op);
+    fflush(stdout);
+}
+
+/*
+    Moves every tile of the padded int board with the cell-level engine (move_tile/swap_tiles/combine_tiles)
+    Traverses the same way the grid engine always has, used to compare against the packed engine
+*/
+void grid_move_all(game_t *game, int dir)
+{
+    for(int index = START; index <= END; index++)
+    {
+        for(int step = 0; step <= END - START; step++)
+        {
+            switch(dir)
+            {
+                case NORTH:
+                    move_tile(game, START + step, index, NORTH);
+                    break;
+                case SOUTH:
+                    move_tile(game, END - step, index, SOUTH);
+                    break;
+                case EAST:
+                    move_tile(game, index, END - step, EAST);
+                    break;
+                case WEST:
+                    move_tile(game, index, START + step, WEST);
+                    break;
+            }
+        }
+    }
+}
+
+// records sparse and full positions from seeded random games
+void record_positions(uint64_t seed)
+{
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
+    int sparse_count = 0;
+    for(uint64_t index = 0; sparse_count < POSITIONS || full_count < POSITIONS; index++)
+    {
+        game_reset(game);
+        game_seed(game, rng_mix_seed(seed, index));
+        place_random_tile(game);
+        while(game_running(game))
+        {
+            if(move_all(game, policy_random(game)))
+            {
+                place_random_tile(game);
+            }
+            if(bitboard_count_empty(game->bitboard) == 0)
+            {
+                if(full_count < POSITIONS)
+                {
+                    full_boards[full_count++] = game->bitboard;
+                }
+            }
+            else if(sparse_count < POSITIONS)
+            {
+                sparse_boards[sparse_count++] = game->bitboard;
+            }
+        }
+    }
+    game_free(game);
+}
+
+// BENCHMARKED OPERATIONS
+
+void op_bitboard_move_north(int index)
+{
+    int points = 0;
+    sink += bitboard_move(sparse_boards[index % POSITIONS], NORTH, &points);
+}
+
+void op_bitboard_move_south(int index)
+{
+    int points = 0;
+    sink += bitboard_move(sparse_boards[index % POSITIONS], SOUTH, &points);
+}
+
+void op_bitboard_move_east(int index)
+{
+    int points = 0;
+    sink += bitboard_move(sparse_boards[index % POSITIONS], EAST, &points);
+}
+
+void op_bitboard_move_west(int index)
+{
+    int points = 0;
+    sink += bitboard_move(sparse_boards[index % POSITIONS], WEST, &points);
+}
+
+// every recorded position fits in the cache, so after the first pass these are all hits
+void op_bitboard_move_cached(int index)
+{
+    int points = 0, moved;
+    sink += bitboard_move_cached(sparse_boards[index % POSITIONS], index % 4, &points, &moved);
+}
+
+// same positions and directions through bitboard_move(), to compare with the cached version
+void op_bitboard_move_uncached(int index)
+{
+    int points = 0;
+    sink += bitboard_move(sparse_boards[index % POSITIONS], index % 4, &points);
+}
+
+// same positions and directions through the whole-board kernel of this CPU (see 2048_simd.c)
+void op_bitboard_move_board(int index)
+{
+    int points = 0;
+    uint8_t changed;
+    sink += bitboard_move_board(sparse_boards[index % POSITIONS], index % 4, &points, &changed);
+}
+
+// picks the smallest of the 8 symmetries of a position, the extra cost of a symmetric table lookup
+void op_bitboard_canonical(int index)
+{
+    sink += bitboard_canonical(sparse_boards[index % POSITIONS], NULL);
+}
+
+// same positions and directions moved through their canonical board and mapped back
+void op_bitboard_move_canonical(int index)
+{
+    int points = 0;
+    int moved;
+    sink += bitboard_move_canonical(sparse_boards[index % POSITIONS], index % 4, &points, &moved);
+}
+
+// values a position with the n-tuple network, weights are all 0 but the lookups are the same as a trained one's
+ntuple_net_t *bench_net;
+
+void op_ntuple_value(int index)
+{
+    sink += ntuple_value(bench_net, sparse_boards[index % POSITIONS]);
+}
+
+// restores a recorded position into the shared game, part of every game-level operation
+void load_position(board_t board)
+{
+    game_set_bitboard(bench_game, board);
+}
+
+void op_load_position(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+}
+
+void op_move_all_north(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    move_all(bench_game, NORTH);
+}
+
+void op_move_all_south(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    move_all(bench_game, SOUTH);
+}
+
+void op_move_all_east(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    move_all(bench_game, EAST);
+}
+
+void op_move_all_west(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    move_all(bench_game, WEST);
+}
+
+void op_grid_move_north(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    grid_move_all(bench_game, NORTH);
+}
+
+void op_grid_move_south(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    grid_move_all(bench_game, SOUTH);
+}
+
+void op_grid_move_east(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    grid_move_all(bench_game, EAST);
+}
+
+void op_grid_move_west(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    grid_move_all(bench_game, WEST);
+}
+
+void op_place_random_tile(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    place_random_tile(bench_game);
+}
+
+void op_bitboard_place_random_tile(int index)
+{
+    sink += bitboard_place_random_tile(sparse_boards[index % POSITIONS], &bench_game->rng);
+}
+
+void op_game_running_sparse(int index)
+{
+    load_position(sparse_boards[index % POSITIONS]);
+    sink += game_running(bench_game);
+}
+
+void op_game_running_full(int index)
+{
+    load_position(full_boards[index % full_count]);
+    sink += game_running(bench_game);
+}
+
+void op_bitboard_running_sparse(int index)
+{
+    sink += bitboard_running(sparse_boards[index % POSITIONS]);
+}
+
+void op_bitboard_running_full(int index)
+{
+    sink += bitboard_running(full_boards[index % full_count]);
+}
+
+void op_empty_list_add_remove(int index)
+{
+    int row = START + index % 4, col = START + (index / 4) % 4;
+    empty_list_remove(bench_game->empty_list, row, col);
+    empty_list_add(bench_game->empty_list, row, col);
+}
+
+void op_empty_list_contains(int index)
+{
+    sink += empty_list_contains(bench_game->empty_list, START + index % 4, START + (index / 4) % 4);
+}
+
+void op_empty_list_get_random(int index)
+{
+    int row, col;
+    empty_list_get_random(bench_game->empty_list, &bench_game->rng, &row, &col);
+    sink += row + col;
+}
+
+// plays one whole game with the random policy, reusing the shared game
+void op_full_game(int index)
+{
+    game_reset(bench_game);
+    game_seed(bench_game, index);
+    place_random_tile(bench_game);
+    while(game_running(bench_game))
+    {
+        if(move_all(bench_game, policy_random(bench_game)))
+        {
+            place_random_tile(bench_game);
+        }
+    }
+    sink += bench_game->points;
+}
+
+// direction game slot of the lockstep benchmarks moves in on a turn, the same for both paths
+int lockstep_dir(int slot, int turn)
+{
+    return (slot * 7 + turn * 3 + turn / 5) % 4;
+}
+
+// starts every lockstep game from a recorded position, in the batch and in the separate games
+void setup_lockstep()
+{
+    lockstep_batch = board_batch_init(LOCKSTEP_GAMES);
+    lockstep_pool = game_pool_init(LOCKSTEP_GAMES, DEFAULT_BOARD_SIZE);
+    for(int slot = 0; slot < LOCKSTEP_GAMES; slot++)
+    {
+        lockstep_games[slot] = game_pool_acquire(lockstep_pool);
+        game_seed(lockstep_games[slot], slot);
+        game_set_bitboard(lockstep_games[slot], sparse_boards[slot]);
+        board_batch_seed(lockstep_batch, slot, slot);
+        lockstep_batch->boards[slot] = sparse_boards[slot];
+    }
+}
+
+// one turn of every game through the batch API: move, spawn where moved, game-over check, finished games restart
+void op_lockstep_batch(int index)
+{
+    for(int slot = 0; slot < LOCKSTEP_GAMES; slot++)
+    {
+        lockstep_batch->dirs[slot] = lockstep_dir(slot, index);
+    }
+    board_batch_step(lockstep_batch);
+    for(int slot = 0; slot < LOCKSTEP_GAMES; slot++)
+    {
+        if(!lockstep_batch->running[slot])
+        {
+            lockstep_batch->boards[slot] = sparse_boards[(slot + index) % POSITIONS];
+        }
+    }
+}
+
+// the same turn one game at a time through move_all(), place_random_tile() and game_running()
+void op_lockstep_games(int index)
+{
+    for(int slot = 0; slot < LOCKSTEP_GAMES; slot++)
+    {
+        game_t *game = lockstep_games[slot];
+        if(move_all(game, lockstep_dir(slot, index)))
+        {
+            place_random_tile(game);
+        }
+        if(!game_running(game))
+        {
+            game_set_bitboard(game, sparse_boards[(slot + index) % POSITIONS]);
+        }
+    }
+}
+
+// allocates and frees a whole game, to compare against reusing one
+void op_game_init_free(int index)
+{
+    game_free(game_init(DEFAULT_BOARD_SIZE));
+}
+
+/*
+    This main method runs every microbenchmark
+    and prints one JSON line of results for each
+*/
+int main(int argc, char **argv)
+{
+    uint64_t seed = argc > 1 ? strtoull(argv[1], NULL, 10) : 1;
+    char *filter = argc > 2 ? argv[2] : NULL;
+    bitboard_init_tables();
+    record_positions(seed);
+    bench_game = game_init(DEFAULT_BOARD_SIZE);
+    game_seed(bench_game, seed);
+
+    run_bench("bitboard_move_north", filter, op_bitboard_move_north, BATCH_OPS);
+    run_bench("bitboard_move_south", filter, op_bitboard_move_south, BATCH_OPS);
+    run_bench("bitboard_move_east", filter, op_bitboard_move_east, BATCH_OPS);
+    run_bench("bitboard_move_west", filter, op_bitboard_move_west, BATCH_OPS);
+    run_bench("bitboard_move_uncached", filter, op_bitboard_move_uncached, BATCH_OPS);
+    run_bench("bitboard_move_cached", filter, op_bitboard_move_cached, BATCH_OPS);
+    char *kernel = bitboard_kernel_name();
+    run_bench("bitboard_move_board", filter, op_bitboard_move_board, BATCH_OPS);
+    bitboard_use_kernel("scalar"); // the same op again through the fallback used on CPUs without SSE4.1
+    run_bench("bitboard_move_board_scalar", filter, op_bitboard_move_board, BATCH_OPS);
+    bitboard_use_kernel(kernel);
+    run_bench("bitboard_canonical", filter, op_bitboard_canonical, BATCH_OPS);
+    run_bench("bitboard_move_canonical", filter, op_bitboard_move_canonical, BATCH_OPS);
+    bench_net = ntuple_create();
+    run_bench("ntuple_value", filter, op_ntuple_value, BATCH_OPS);
+    ntuple_free(bench_net);
+    run_bench("load_position", filter, op_load_position, BATCH_OPS);
+    run_bench("move_all_north", filter, op_move_all_north, BATCH_OPS);
+    run_bench("move_all_south", filter, op_move_all_south, BATCH_OPS);
+    run_bench("move_all_east", filter, op_move_all_east, BATCH_OPS);
+    run_bench("move_all_west", filter, op_move_all_west, BATCH_OPS);
+    run_bench("grid_move_north", filter, op_grid_move_north, BATCH_OPS);
+    run_bench("grid_move_south", filter, op_grid_move_south, BATCH_OPS);
+    run_bench("grid_move_east", filter, op_grid_move_east, BATCH_OPS);
+    run_bench("grid_move_west", filter, op_grid_move_west, BATCH_OPS);
+    run_bench("place_random_tile", filter, op_place_random_tile, BATCH_OPS);
+    run_bench("bitboard_place_random_tile", filter, op_bitboard_place_random_tile, BATCH_OPS);
+    run_bench("game_running_sparse", filter, op_game_running_sparse, BATCH_OPS);
+    run_bench("game_running_full", filter, op_game_running_full, BATCH_OPS);
+    run_bench("bitboard_running_sparse", filter, op_bitboard_running_sparse, BATCH_OPS);
+    run_bench("bitboard_running_full", filter, op_bitboard_running_full, BATCH_OPS);
+    game_reset(bench_game); // list benchmarks run on a list holding every location
+    run_bench("empty_list_add_remove", filter, op_empty_list_add_remove, BATCH_OPS);
+    run_bench("empty_list_contains", filter, op_empty_list_contains, BATCH_OPS);
+    run_bench("empty_list_get_random", filter, op_empty_list_get_random, BATCH_OPS);
+    run_bench("game_init_free", filter, op_game_init_free, BATCH_OPS);
+    run_bench("full_game", filter, op_full_game, GAME_OPS);
+    setup_lockstep();
+    run_bench("lockstep_batch_1024", filter, op_lockstep_batch, LOCKSTEP_OPS);
+    run_bench("lockstep_games_1024", filter, op_lockstep_games, LOCKSTEP_OPS);
+    board_batch_free(lockstep_batch);
+    game_pool_free(lockstep_pool);
+
+    game_free(bench_game);
+    return 0;
+}
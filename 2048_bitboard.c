@@ -0,0 +1,395 @@
+#include "2048.h"
+#include <pthread.h>
+
+/*
+    Packed bitboard implementation of the 2048 board.
+
+    The 16 cells of the 4x4 board are stored in a single board_t (uint64_t).
+    Each cell holds the log2 exponent of its tile in 4 bits (0 for EMPTY, 1 for 2, 2 for 4, ...),
+    so the largest representable tile is 2^15 = 32768.
+
+    Row 0 is the top row and lives in the lowest 16 bits, col 0 is the leftmost
+    cell and lives in the lowest 4 bits of its row.
+*/
+
+// returns the bit offset of the cell at row-col
+static int cell_shift(int row, int col)
+{
+    return row * ROW_BITS + col * CELL_BITS;
+}
+
+// converts a tile value (2, 4, 8, ...) into its log2 exponent, EMPTY stays 0
+static int tile_to_exponent(int value)
+{
+    int exponent = 0;
+    while(value > 1)
+    {
+        value >>= 1;
+        exponent++;
+    }
+    return exponent;
+}
+
+// converts a log2 exponent back into its tile value, 0 stays EMPTY
+static int exponent_to_tile(int exponent)
+{
+    if(exponent == 0)
+    {
+        return EMPTY;
+    }
+    return 1 << exponent;
+}
+
+///////////////////////////////////
+// FUNCTIONS FOR READING BOARDS //
+/////////////////////////////////
+
+// returns the tile value at row-col (EMPTY if there is no tile)
+int bitboard_get_tile(board_t board, int row, int col)
+{
+    return exponent_to_tile((board >> cell_shift(row, col)) & CELL_MASK);
+}
+
+// returns a copy of board with the given tile value placed at row-col
+board_t bitboard_set_tile(board_t board, int row, int col, int value)
+{
+    int shift = cell_shift(row, col);
+    board &= ~(CELL_MASK << shift);
+    board |= (board_t)tile_to_exponent(value) << shift;
+    return board;
+}
+
+/*
+    Returns a 16 bit mask with bit (row * 4 + col) set for every cell that does not hold a tile
+    Each nibble is folded into its lowest bit, then the lowest bits are gathered together
+*/
+uint16_t bitboard_empty_mask(board_t board)
+{
+    board_t filled = board | (board >> 1) | (board >> 2) | (board >> 3);
+    filled &= 0x1111111111111111ULL; // lowest bit of each nibble is set when that cell holds a tile
+    filled = (filled | (filled >> 3)) & 0x0303030303030303ULL;
+    filled = (filled | (filled >> 6)) & 0x000F000F000F000FULL;
+    filled = (filled | (filled >> 12)) & 0x000000FF000000FFULL;
+    filled = (filled | (filled >> 24)) & 0xFFFFULL;
+    return (uint16_t)~filled;
+}
+
+// returns amount of cells on the board that do not hold a tile
+int bitboard_count_empty(board_t board)
+{
+    return __builtin_popcount(bitboard_empty_mask(board));
+}
+
+// returns the value of the biggest tile on the board
+int bitboard_highest_tile(board_t board)
+{
+    int highest = 0;
+    for(int cell = 0; cell < BITBOARD_LENGTH * BITBOARD_LENGTH; cell++)
+    {
+        int exponent = (board >> (cell * CELL_BITS)) & CELL_MASK;
+        if(exponent > highest)
+        {
+            highest = exponent;
+        }
+    }
+    return exponent_to_tile(highest);
+}
+
+/*
+    Swaps rows with columns (cell row-col moves to col-row)
+    This lets NORTH/SOUTH moves reuse the row logic of WEST/EAST
+*/
+board_t bitboard_transpose(board_t board)
+{
+    // swap the 2x2 blocks of cells, then the cells within each block
+    board_t a1 = board & 0xF0F00F0FF0F00F0FULL;
+    board_t a2 = board & 0x0000F0F00000F0F0ULL;
+    board_t a3 = board & 0x0F0F00000F0F0000ULL;
+    board_t a = a1 | (a2 << 12) | (a3 >> 12);
+    board_t b1 = a & 0xFF00FF0000FF00FFULL;
+    board_t b2 = a & 0x00FF00FF00000000ULL;
+    board_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+//////////////////////////////////
+// FUNCTIONS FOR MOVING BOARDS //
+////////////////////////////////
+
+// transition tables indexed by packed row, built once by bitboard_init_tables()
+static row_move_t west_table[ROW_COUNT];
+static row_move_t east_table[ROW_COUNT];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+// mirrors one packed row so that col 0 becomes col 3 and the other way around
+uint16_t bitboard_reverse_row(uint16_t row)
+{
+    return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12);
+}
+
+/*
+    Slides and merges one packed row towards col 0 (WEST)
+    Each tile can only merge once per move, same as the rules of 2048
+
+    Only used to fill the transition tables, returns the result of the slide
+*/
+static row_move_t compute_row_west(uint16_t row)
+{
+    int cells[BITBOARD_LENGTH] = {0};
+    int length = 0; // amount of tiles placed into cells so far
+    int merged = 0; // whether the last placed tile was produced by a merge
+    row_move_t move = {0, 0, 0};
+    for(int col = 0; col < BITBOARD_LENGTH; col++)
+    {
+        int exponent = (row >> (col * CELL_BITS)) & CELL_MASK;
+        if(exponent == 0)
+        {
+            continue;
+        }
+        // merge into previous tile if equal and previous tile has not merged already
+        if(length > 0 && !merged && cells[length - 1] == exponent && exponent < CELL_MASK)
+        {
+            cells[length - 1]++;
+            move.points += exponent_to_tile(cells[length - 1]);
+            merged = 1;
+        }
+        else
+        {
+            cells[length++] = exponent;
+            merged = 0;
+        }
+    }
+    for(int col = 0; col < BITBOARD_LENGTH; col++)
+    {
+        move.row |= cells[col] << (col * CELL_BITS);
+    }
+    move.changed = (move.row != row);
+    return move;
+}
+
+/*
+    Builds the west and east transition tables for all 65536 packed rows
+    East results are the mirrored west results of the mirrored row
+*/
+static void build_tables()
+{
+    for(int row = 0; row < ROW_COUNT; row++)
+    {
+        west_table[row] = compute_row_west(row);
+        uint16_t reversed = bitboard_reverse_row(row);
+        row_move_t east = compute_row_west(reversed);
+        east.row = bitboard_reverse_row(east.row);
+        east_table[row] = east; // indexed by the original (unmirrored) row
+    }
+    bitboard_init_kernels(); // the vector kernels are built on top of the tables
+}
+
+// builds the row tables and picks the whole-board move kernel, only the first call does the work and threads may race to it
+void bitboard_init_tables()
+{
+    pthread_once(&tables_once, build_tables);
+}
+
+// returns the west and east transition tables, for kernels that look rows up themselves (see 2048_batch.c)
+void bitboard_row_tables(const row_move_t **westP, const row_move_t **eastP)
+{
+    bitboard_init_tables();
+    *westP = west_table;
+    *eastP = east_table;
+}
+
+// slides + merges one packed row towards col 0 through the west table, adds points gained to *points
+uint16_t bitboard_move_row_west(uint16_t row, int *points)
+{
+    *points += west_table[row].points;
+    return west_table[row].row;
+}
+
+// slides + merges one packed row towards col 3 through the east table, adds points gained to *points
+uint16_t bitboard_move_row_east(uint16_t row, int *points)
+{
+    *points += east_table[row].points;
+    return east_table[row].row;
+}
+
+/*
+    Moves all rows/columns of the board in the direction given
+    Each row (or column after transposing) is a single table lookup
+
+    Points gained from merges are added to *points, returns the new board
+*/
+board_t bitboard_move(board_t board, int dir, int *points)
+{
+    int transposed = (dir == NORTH || dir == SOUTH);
+    if(transposed) // columns become rows
+    {
+        board = bitboard_transpose(board);
+    }
+    row_move_t *table = (dir == WEST || dir == NORTH) ? west_table : east_table;
+    board_t result = 0;
+    for(int row = 0; row < BITBOARD_LENGTH; row++)
+    {
+        row_move_t *move = &table[(board >> (row * ROW_BITS)) & ROW_MASK];
+        result |= (board_t)move->row << (row * ROW_BITS);
+        *points += move->points;
+    }
+    if(transposed)
+    {
+        result = bitboard_transpose(result);
+    }
+    return result;
+}
+
+/*
+    Moves a single row (EAST/WEST) or column (NORTH/SOUTH) of the board, index is 0-indexed
+    Points gained from merges are added to *points, returns the new board
+*/
+board_t bitboard_move_line(board_t board, int index, int dir, int *points)
+{
+    int transposed = (dir == NORTH || dir == SOUTH);
+    if(transposed) // the column becomes a row
+    {
+        board = bitboard_transpose(board);
+    }
+    row_move_t *table = (dir == WEST || dir == NORTH) ? west_table : east_table;
+    int shift = index * ROW_BITS;
+    row_move_t *move = &table[(board >> shift) & ROW_MASK];
+    board = (board & ~(ROW_MASK << shift)) | ((board_t)move->row << shift);
+    *points += move->points;
+    if(transposed)
+    {
+        board = bitboard_transpose(board);
+    }
+    return board;
+}
+
+////////////////////////////////////////////
+// FUNCTIONS FOR CHECKING + ADDING TILES //
+//////////////////////////////////////////
+
+// returns 1 if any two adjacent cells within a row hold the same tile, two 32768s never merge (same as the row tables)
+static int has_row_merge(board_t board)
+{
+    for(int row = 0; row < BITBOARD_LENGTH; row++)
+    {
+        for(int col = 0; col < BITBOARD_LENGTH - 1; col++)
+        {
+            int shift = cell_shift(row, col);
+            int exponent = (board >> shift) & CELL_MASK;
+            if(exponent != CELL_MASK && exponent == ((board >> (shift + CELL_BITS)) & CELL_MASK))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// checks if the game can continue: either an empty cell exists or two adjacent tiles can be combined
+int bitboard_running(board_t board)
+{
+    if(bitboard_count_empty(board) != 0)
+    {
+        return 1;
+    }
+    return has_row_merge(board) || has_row_merge(bitboard_transpose(board));
+}
+
+/*
+    Places a 2 or 4 at a random empty cell, returns board unchanged if it is full
+    The cell is picked with popcount/select on the empty mask instead of walking the board
+*/
+board_t bitboard_place_random_tile(board_t board, rng_t *rng)
+{
+    uint16_t empty = bitboard_empty_mask(board);
+    if(empty == 0)
+    {
+        return board;
+    }
+    int rand_index = rng_range(rng, __builtin_popcount(empty));
+    int value = pick_random_tile(rng);
+    // select: clear the lowest set bits until the one at the random index is the lowest
+    for(int skipped = 0; skipped < rand_index; skipped++)
+    {
+        empty &= empty - 1;
+    }
+    int cell = __builtin_ctz(empty);
+    return board | ((board_t)tile_to_exponent(value) << (cell * CELL_BITS));
+}
+
+/*
+    Returns a mask of the lines that can move in the given direction (bit i for row/col i)
+    Rows are checked for EAST/WEST and cols for NORTH/SOUTH, each line is one table lookup
+*/
+uint8_t bitboard_line_moves(board_t board, int dir)
+{
+    if(dir == NORTH || dir == SOUTH) // columns become rows
+    {
+        board = bitboard_transpose(board);
+    }
+    row_move_t *table = (dir == WEST || dir == NORTH) ? west_table : east_table;
+    uint8_t lines = 0;
+    for(int line = 0; line < BITBOARD_LENGTH; line++)
+    {
+        lines |= table[(board >> (line * ROW_BITS)) & ROW_MASK].changed << line;
+    }
+    return lines;
+}
+
+/*
+    Recomputes line_moves (one line mask per direction) only for the rows and cols that
+    differ between old_board and board; every other line keeps its cached legality
+*/
+void bitboard_update_line_moves(board_t old_board, board_t board, uint8_t line_moves[4])
+{
+    uint16_t changed = ~bitboard_empty_mask(old_board ^ board); // cells whose exponent changed
+    uint8_t rows = 0;
+    for(int row = 0; row < BITBOARD_LENGTH; row++)
+    {
+        rows |= (((changed >> (row * BITBOARD_LENGTH)) & 0xF) != 0) << row;
+    }
+    uint8_t cols = (changed | (changed >> 4) | (changed >> 8) | (changed >> 12)) & 0xF;
+    board_t transposed = bitboard_transpose(board);
+    for(int line = 0; line < BITBOARD_LENGTH; line++)
+    {
+        uint8_t bit = 1 << line;
+        if(rows & bit)
+        {
+            uint16_t row = (board >> (line * ROW_BITS)) & ROW_MASK;
+            line_moves[WEST] = (line_moves[WEST] & ~bit) | (west_table[row].changed << line);
+            line_moves[EAST] = (line_moves[EAST] & ~bit) | (east_table[row].changed << line);
+        }
+        if(cols & bit)
+        {
+            uint16_t col = (transposed >> (line * ROW_BITS)) & ROW_MASK;
+            line_moves[NORTH] = (line_moves[NORTH] & ~bit) | (west_table[col].changed << line);
+            line_moves[SOUTH] = (line_moves[SOUTH] & ~bit) | (east_table[col].changed << line);
+        }
+    }
+}
+
+// returns a mask with bit dir set for every direction that changes the board
+int bitboard_legal_moves(board_t board)
+{
+    int moves = 0;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        moves |= (bitboard_line_moves(board, dir) != 0) << dir;
+    }
+    return moves;
+}
+
+// prints the tiles of a packed board, for debugging
+void bitboard_print(board_t board)
+{
+    printf("\n");
+    for(int row = 0; row < BITBOARD_LENGTH; row++)
+    {
+        for(int col = 0; col < BITBOARD_LENGTH; col++)
+        {
+            printf("%6d", bitboard_get_tile(board, row, col));
+        }
+        printf("\n");
+    }
+    printf("bitboard: 0x%016llx\n", (unsigned long long)board);
+}
@@ -0,0 +1,96 @@
+#include "2048.h"
+#include <stdatomic.h>
+
+/*
+    Successor cache for moves on packed bitboards
+
+    Search and simulation move the same boards over and over (every direction from one
+    parent, boards reached again through different spawns, deeper passes of iterative
+    deepening), so the result of each (board, direction) is kept in a fixed-size table.
+
+    The table is shared by every thread without locks, the same way the transposition table
+    of the AI is: an entry stores its result, its data (points, moved flag and direction) and
+    a key of board ^ result ^ data. A reader only trusts an entry if its key gives back the
+    board it is looking for, so an entry torn by two threads writing at once is just a miss.
+
+    Hits and misses are counted per thread and added to shared totals by move_cache_flush_stats().
+*/
+
+// one cached move, safe to share between threads without locks
+typedef struct
+{
+    _Atomic uint64_t key; // board ^ result ^ data
+    _Atomic uint64_t result; // board after the move
+    _Atomic uint64_t data; // points << 3 | moved << 2 | dir
+}
+move_cache_entry_t;
+
+static move_cache_entry_t move_cache[MOVE_CACHE_SIZE];
+
+// counters of the calling thread, and the totals of every flushed thread
+static __thread long thread_hits;
+static __thread long thread_misses;
+static _Atomic long total_hits;
+static _Atomic long total_misses;
+
+// hashes a board and direction into an index of the cache
+static uint32_t move_cache_index(board_t board, int dir)
+{
+    return (uint32_t)(((board ^ ((uint64_t)dir << 62)) * 0x9E3779B97F4A7C15ULL) >> (64 - MOVE_CACHE_BITS));
+}
+
+/*
+    Moves all rows/cols of the board in dir like bitboard_move_board(), looking the result up in the cache first
+    Points gained are added to *points and *movedP is set to 1 if the move changed the board, otherwise 0
+*/
+board_t bitboard_move_cached(board_t board, int dir, int *points, int *movedP)
+{
+    move_cache_entry_t *entry = &move_cache[move_cache_index(board, dir)];
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t result = atomic_load_explicit(&entry->result, memory_order_relaxed);
+    uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+    if((key ^ result ^ data) == board && (int)(data & 3) == dir) // an unused (zeroed) slot only matches the empty board, which cannot move
+    {
+        thread_hits++;
+        *points += (int)(data >> 3);
+        *movedP = (data >> 2) & 1;
+        return result;
+    }
+    thread_misses++;
+    int gained = 0;
+    uint8_t changed;
+    result = bitboard_move_board(board, dir, &gained, &changed);
+    *points += gained;
+    *movedP = changed != 0;
+    data = ((uint64_t)gained << 3) | ((uint64_t)*movedP << 2) | dir;
+    atomic_store_explicit(&entry->result, result, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+    atomic_store_explicit(&entry->key, board ^ result ^ data, memory_order_relaxed);
+    return result;
+}
+
+// adds the calling thread's hit and miss counts to the shared totals and resets them
+void move_cache_flush_stats()
+{
+    atomic_fetch_add(&total_hits, thread_hits);
+    atomic_fetch_add(&total_misses, thread_misses);
+    thread_hits = 0;
+    thread_misses = 0;
+}
+
+// returns the hits and misses of every flushed thread plus those of the calling thread
+void move_cache_stats(long *hitsP, long *missesP)
+{
+    *hitsP = atomic_load(&total_hits) + thread_hits;
+    *missesP = atomic_load(&total_misses) + thread_misses;
+}
+
+// empties the cache and resets every counter, no other thread may use the cache meanwhile
+void move_cache_clear()
+{
+    memset(move_cache, 0, sizeof(move_cache));
+    atomic_store(&total_hits, 0);
+    atomic_store(&total_misses, 0);
+    thread_hits = 0;
+    thread_misses = 0;
+}
@@ -0,0 +1,219 @@
+#include "2048.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    Columnar datasets of simulated moves for training evaluators offline
+
+    Every row is one move: the packed board before it, the direction, the points it gained
+    and whether the game was over afterwards. Rows are grouped in fixed-size blocks that hold
+    each column as its own array, so a reader can map the file and scan any column in place.
+
+    Each writer fills a block in memory and writes it with a single pwrite() once it is full.
+    The offset of a block is reserved with one atomic add on the shared file, so any amount of
+    threads can write to the same file without locks. Blocks of different writers interleave,
+    and only the last block of each writer can be partly filled.
+
+    File layout (little-endian): dataset_header_t, then block_count dataset_block_t.
+*/
+
+// returns the file offset of the given block
+static off_t block_offset(uint64_t block)
+{
+    return sizeof(dataset_header_t) + block * sizeof(dataset_block_t);
+}
+
+// creates (or truncates) a dataset file for writers to share, returns NULL if it cannot be created
+dataset_file_t *dataset_file_create(char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    dataset_file_t *file = malloc(sizeof(dataset_file_t));
+    file->fd = fd;
+    atomic_init(&file->next_block, 0);
+    atomic_init(&file->row_count, 0);
+    return file;
+}
+
+/*
+    Writes the header now that every block is known and closes the file
+    Every writer of the file has to be flushed first, returns 1 on success
+*/
+int dataset_file_close(dataset_file_t *file)
+{
+    dataset_header_t header =
+    {
+        .magic = DATASET_MAGIC,
+        .version = DATASET_VERSION,
+        .block_rows = DATASET_BLOCK_ROWS,
+        .block_count = atomic_load(&file->next_block),
+        .row_count = atomic_load(&file->row_count),
+    };
+    int ok = pwrite(file->fd, &header, sizeof(header), 0) == sizeof(header);
+    ok = close(file->fd) == 0 && ok;
+    free(file);
+    return ok;
+}
+
+// allocates a writer for the file with an empty block
+dataset_writer_t *dataset_writer_init(dataset_file_t *file)
+{
+    dataset_writer_t *writer = calloc(1, sizeof(dataset_writer_t));
+    writer->file = file;
+    return writer;
+}
+
+/*
+    Writes the writer's block to the next free slot of the file, even if it is not full
+    Unused rows are zeroed so the file does not depend on what the block held before
+*/
+void dataset_writer_flush(dataset_writer_t *writer)
+{
+    dataset_block_t *block = &writer->block;
+    uint32_t rows = block->row_count;
+    if(rows == 0)
+    {
+        return;
+    }
+    if(rows < DATASET_BLOCK_ROWS)
+    {
+        memset(&block->boards[rows], 0, (DATASET_BLOCK_ROWS - rows) * sizeof(board_t));
+        memset(&block->rewards[rows], 0, (DATASET_BLOCK_ROWS - rows) * sizeof(int32_t));
+        memset(&block->moves[rows], 0, DATASET_BLOCK_ROWS - rows);
+        memset(&block->terminal[rows], 0, DATASET_BLOCK_ROWS - rows);
+    }
+    uint64_t index = atomic_fetch_add(&writer->file->next_block, 1);
+    if(pwrite(writer->file->fd, block, sizeof(dataset_block_t), block_offset(index)) != sizeof(dataset_block_t))
+    {
+        perror("dataset block write");
+    }
+    atomic_fetch_add(&writer->file->row_count, rows);
+    block->row_count = 0;
+}
+
+// appends one row to the writer's block, writing the block out when it fills up
+void dataset_writer_add(dataset_writer_t *writer, board_t board, int dir, int reward, int terminal)
+{
+    dataset_block_t *block = &writer->block;
+    uint32_t row = block->row_count++;
+    block->boards[row] = board;
+    block->rewards[row] = reward;
+    block->moves[row] = dir;
+    block->terminal[row] = terminal;
+    if(block->row_count == DATASET_BLOCK_ROWS)
+    {
+        dataset_writer_flush(writer);
+    }
+}
+
+// writes whatever is left in the writer's block and frees the writer
+void dataset_writer_free(dataset_writer_t *writer)
+{
+    dataset_writer_flush(writer);
+    free(writer);
+}
+
+/*
+    Maps a dataset file read-only, the blocks are used in place without copying them
+    Returns NULL if the file cannot be mapped or does not match the format,
+    including blocks with more rows than they hold or row counts that do not add up to the header's
+*/
+dataset_t *dataset_open(char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(dataset_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays valid after the descriptor is closed
+    if(data == MAP_FAILED)
+    {
+        return NULL;
+    }
+    dataset_header_t *header = data;
+    if(header->magic != DATASET_MAGIC || header->version != DATASET_VERSION || header->block_rows != DATASET_BLOCK_ROWS ||
+        (uint64_t)info.st_size < (uint64_t)block_offset(header->block_count))
+    {
+        munmap(data, info.st_size);
+        return NULL;
+    }
+    dataset_t *dataset = malloc(sizeof(dataset_t));
+    dataset->header = header;
+    dataset->blocks = (dataset_block_t *)((char *)data + sizeof(dataset_header_t));
+    dataset->size = info.st_size;
+    dataset->block_starts = malloc(sizeof(uint64_t) * (header->block_count + 1));
+    dataset->block_starts[0] = 0;
+    for(uint32_t block = 0; block < header->block_count; block++)
+    {
+        if(dataset->blocks[block].row_count > DATASET_BLOCK_ROWS) // readers would index past the block's columns
+        {
+            dataset_close(dataset);
+            return NULL;
+        }
+        dataset->block_starts[block + 1] = dataset->block_starts[block] + dataset->blocks[block].row_count;
+    }
+    if(dataset->block_starts[header->block_count] != header->row_count)
+    {
+        dataset_close(dataset);
+        return NULL;
+    }
+    return dataset;
+}
+
+// unmaps a dataset and frees its block index
+void dataset_close(dataset_t *dataset)
+{
+    munmap(dataset->header, dataset->size);
+    free(dataset->block_starts);
+    free(dataset);
+}
+
+// returns the amount of rows in the dataset
+uint64_t dataset_row_count(dataset_t *dataset)
+{
+    return dataset->header->row_count;
+}
+
+/*
+    Reads the row with the given index, finding its block with a binary search over the block starts
+    Returns 0 if the index is out of range, scanning blocks->boards etc. directly avoids the search
+*/
+int dataset_row(dataset_t *dataset, uint64_t index, board_t *boardP, int *dirP, int *rewardP, int *terminalP)
+{
+    if(index >= dataset->header->row_count)
+    {
+        return 0;
+    }
+    uint32_t low = 0, high = dataset->header->block_count; // block_starts[low] <= index < block_starts[high]
+    while(high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if(dataset->block_starts[middle] <= index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    dataset_block_t *block = &dataset->blocks[low];
+    uint32_t row = index - dataset->block_starts[low];
+    *boardP = block->boards[row];
+    *dirP = block->moves[row];
+    *rewardP = block->rewards[row];
+    *terminalP = block->terminal[row];
+    return 1;
+}
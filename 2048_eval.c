@@ -0,0 +1,218 @@
+#include "2048.h"
+#include <math.h>
+
+/*
+    Heuristic evaluation of packed bitboards
+
+    Every heuristic term only depends on the 4 cells of one row (or column), so the
+    weighted sum of all terms is precomputed for all 65536 packed rows. Scoring a board
+    is then 4 lookups for its rows plus 4 lookups for the rows of its transpose.
+
+    Weights can be changed at runtime with eval_load_weights(), which rebuilds the table.
+*/
+
+// weights currently used by the table, defaults are used until a config file is loaded
+static eval_weights_t weights =
+{
+    .lost_penalty = 200000.0f,
+    .empty_weight = 270.0f,
+    .merges_weight = 700.0f,
+    .monotonicity_power = 4.0f,
+    .monotonicity_weight = 47.0f,
+    .sum_power = 3.5f,
+    .sum_weight = 11.0f,
+    .smoothness_weight = 0.0f,
+    .corner_weight = 0.0f,
+};
+
+// names used for each weight in config files
+static struct
+{
+    char *name;
+    float *value;
+}
+weight_names[] =
+{
+    {"lost_penalty", &weights.lost_penalty},
+    {"empty_weight", &weights.empty_weight},
+    {"merges_weight", &weights.merges_weight},
+    {"monotonicity_power", &weights.monotonicity_power},
+    {"monotonicity_weight", &weights.monotonicity_weight},
+    {"sum_power", &weights.sum_power},
+    {"sum_weight", &weights.sum_weight},
+    {"smoothness_weight", &weights.smoothness_weight},
+    {"corner_weight", &weights.corner_weight},
+};
+
+// heuristic score of every packed row
+static float row_scores[ROW_COUNT];
+static int eval_tables_built = 0;
+
+// computes the weighted heuristic score of one packed row (exponents, not tile values)
+static float score_row(uint16_t row)
+{
+    int cells[BITBOARD_LENGTH];
+    for(int col = 0; col < BITBOARD_LENGTH; col++)
+    {
+        cells[col] = (row >> (col * CELL_BITS)) & CELL_MASK;
+    }
+    float sum = 0.0f;
+    int empty = 0;
+    int merges = 0;
+    int previous = 0; // last non-empty tile, used to count merges across gaps
+    int counter = 0; // length of the current run of equal tiles
+    int highest = 0;
+    for(int col = 0; col < BITBOARD_LENGTH; col++)
+    {
+        int rank = cells[col];
+        sum += powf(rank, weights.sum_power);
+        if(rank == 0)
+        {
+            empty++;
+            continue;
+        }
+        if(rank > highest)
+        {
+            highest = rank;
+        }
+        if(previous == rank)
+        {
+            counter++;
+        }
+        else if(counter > 0)
+        {
+            merges += 1 + counter;
+            counter = 0;
+        }
+        previous = rank;
+    }
+    if(counter > 0)
+    {
+        merges += 1 + counter;
+    }
+
+    // monotonicity: penalize the row for going up in one direction and down in the other
+    float monotonicity_left = 0.0f;
+    float monotonicity_right = 0.0f;
+    float smoothness = 0.0f;
+    for(int col = 1; col < BITBOARD_LENGTH; col++)
+    {
+        float left = powf(cells[col - 1], weights.monotonicity_power);
+        float right = powf(cells[col], weights.monotonicity_power);
+        if(cells[col - 1] > cells[col])
+        {
+            monotonicity_left += left - right;
+        }
+        else
+        {
+            monotonicity_right += right - left;
+        }
+        if(cells[col - 1] != 0 && cells[col] != 0)
+        {
+            smoothness += abs(cells[col - 1] - cells[col]);
+        }
+    }
+    float monotonicity = monotonicity_left < monotonicity_right ? monotonicity_left : monotonicity_right;
+
+    // corner: reward rows whose biggest tile sits at one of their ends
+    int cornered = highest != 0 && (cells[0] == highest || cells[BITBOARD_LENGTH - 1] == highest);
+
+    return weights.lost_penalty
+        + weights.empty_weight * empty
+        + weights.merges_weight * merges
+        - weights.monotonicity_weight * monotonicity
+        - weights.sum_weight * sum
+        - weights.smoothness_weight * smoothness
+        + weights.corner_weight * (cornered ? highest : 0);
+}
+
+// builds the row score table from the current weights, only built once unless the weights change
+void eval_init_tables()
+{
+    if(eval_tables_built)
+    {
+        return;
+    }
+    for(int row = 0; row < ROW_COUNT; row++)
+    {
+        row_scores[row] = score_row(row);
+    }
+    eval_tables_built = 1;
+}
+
+// returns the weight with the given config name, NULL if there is none
+static float *find_weight(char *name)
+{
+    for(int index = 0; index < (int)(sizeof(weight_names) / sizeof(weight_names[0])); index++)
+    {
+        if(strcmp(weight_names[index].name, name) == 0)
+        {
+            return weight_names[index].value;
+        }
+    }
+    return NULL;
+}
+
+/*
+    Loads weights from a config file of "name value" lines ('#' starts a comment) and rebuilds the table
+    Names that are missing keep their current value
+
+    Returns 1 on success, 0 if the file cannot be opened or has an unknown name
+*/
+int eval_load_weights(char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        return 0;
+    }
+    char line[256];
+    int ok = 1;
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[64];
+        float value;
+        if(line[0] == '#' || sscanf(line, "%63s %f", name, &value) != 2)
+        {
+            continue;
+        }
+        float *weight = find_weight(name);
+        if(weight == NULL)
+        {
+            printf("unknown weight in %s: %s\n", path, name);
+            ok = 0;
+            continue;
+        }
+        *weight = value;
+    }
+    fclose(file);
+    eval_tables_built = 0; // weights changed, table has to be rebuilt
+    eval_init_tables();
+    return ok;
+}
+
+// returns the weights currently used by the evaluation table
+eval_weights_t eval_get_weights()
+{
+    return weights;
+}
+
+// scores a packed board with 8 table lookups (4 rows and the 4 rows of its transpose), bigger is better
+float eval_board(board_t board)
+{
+    board_t transposed = bitboard_transpose(board);
+    return row_scores[board & ROW_MASK] +
+        row_scores[(board >> ROW_BITS) & ROW_MASK] +
+        row_scores[(board >> (2 * ROW_BITS)) & ROW_MASK] +
+        row_scores[(board >> (3 * ROW_BITS)) & ROW_MASK] +
+        row_scores[transposed & ROW_MASK] +
+        row_scores[(transposed >> ROW_BITS) & ROW_MASK] +
+        row_scores[(transposed >> (2 * ROW_BITS)) & ROW_MASK] +
+        row_scores[(transposed >> (3 * ROW_BITS)) & ROW_MASK];
+}
+
+// scores the board of a game, the game's bitboard is already the packed form of game->board[START..END][START..END]
+float eval_game(game_t *game)
+{
+    return eval_board(game->bitboard);
+}
@@ -11,82 +11,67 @@ int dir_y[4] = {-1, 1, 0, 0};
 // FUNCTIONS FOR LIST // 
 ////////////////////////
 
-// allocates space for an empty_list with 0 nodes
+// allocates space for an empty_list with 0 locations; this is the only allocation the list makes
 empty_list_t *empty_list_init()
 {
     empty_list_t *empty_list = malloc(sizeof(empty_list_t));
-    empty_list->front = NULL;
-    empty_list->length = 0;
+    empty_list_reset(empty_list);
     return empty_list;
 }
 
-// frees space allocated by empty_list and all nodes in it
+// frees space allocated by empty_list
 void empty_list_free(empty_list_t *list)
 {
-    list_node_t *curr = list->front;
-    while(curr != NULL)
+    free(list);
+}
+
+// removes every location from the list in place (also used on uninitialized storage), without any allocator calls
+void empty_list_reset(empty_list_t *list)
+{
+    for(int index = 0; index < EMPTY_LIST_CAPACITY; index++)
     {
-        list_node_t *deallocate = curr;
-        curr = curr->next;
-        free(deallocate);
+        list->position[index] = NOT_IN_LIST;
     }
-    free(list);
+    list->length = 0;
 }
 
 /*
     Adds given row-col elements on board to the empty_list
     Indicates that this spot has no tiles
-    List add is done at the front
+    List add is done at the back of the dense array, adding a location twice does nothing
 */
 void empty_list_add(empty_list_t *list, int row, int col)
 {
-    list_node_t *new_node = malloc(sizeof(list_node_t));
-    new_node->row = row;
-    new_node->col = col;
-    if(list->length == 0) // special case, no elements in list
+    int location = row * MAX_BOARD_LENGTH + col;
+    if(list->position[location] != NOT_IN_LIST)
     {
-        new_node->next = NULL;
+        return;
     }
-    else
-    {
-        new_node->next = list->front;
-    }
-    list->front = new_node;
+    list->cells[list->length] = location;
+    list->position[location] = list->length;
     list->length++;
 }
 
 /*
     Removes element with given row-col elements from the empty list
-    uses a list traversal in order to find the element
+    the last element of the dense array is moved into the removed element's slot
 
     If the row-col elements are found return 1. if not found return 0
 */
 int empty_list_remove(empty_list_t *list, int row, int col)
 {
-    list_node_t *curr = list->front;
-    list_node_t *prev = NULL;
-    // loop until element with row-col coordinates is found or list traversal is complete
-    while(curr != NULL)
+    int location = row * MAX_BOARD_LENGTH + col;
+    int index = list->position[location];
+    if(index == NOT_IN_LIST) // row-col elements were not found
     {
-        if(curr->row == row && curr->col == col) // removal now occurs
-        {
-            list_node_t *deallocate = curr;
-            if(curr == list->front) // special case, move front
-            {
-                list->front = list->front->next;
-            }
-            else
-            {
-                prev->next = curr->next;
-            }
-            free(deallocate);
-            list->length--;
-            return 1;
-        }
-        prev = curr;
-        curr = curr->next;
+        return 0;
     }
-    return 0; // row-col elements were not found
+    int last = list->cells[list->length - 1];
+    list->cells[index] = last;
+    list->position[last] = index;
+    list->position[location] = NOT_IN_LIST;
+    list->length--;
+    return 1;
 }
 
 /*
@@ -96,39 +81,22 @@ int empty_list_remove(empty_list_t *list, int row, int col)
 */
 int empty_list_contains(empty_list_t *list, int row, int col)
 {
-    list_node_t *curr = list->front;
-    while(curr != NULL)
-    {
-        if(curr->row == row && curr->col == col)
-        {
-            return 1;
-        }
-        curr = curr->next;
-    }
-    return 0;
+    return list->position[row * MAX_BOARD_LENGTH + col] != NOT_IN_LIST;
 }
 
 /*
     Gets a random set of row-col coordinates from empty_list and assigns them to parameter row/col 
     If list is empty this method cannot work and returns 0 for failure, otherwise return 1 for success
 */
-int empty_list_get_random(empty_list_t *list, int *rowP, int *colP)
+int empty_list_get_random(empty_list_t *list, rng_t *rng, int *rowP, int *colP)
 {
     if(list->length == 0) // cannot get random coordinates
     {
         return 0;
     }
-    int rand_index = rand() % list->length; // generate random index
-    // loop until element at index is found
-    list_node_t *curr = list->front;
-    int index = 0;
-    while(index != rand_index)
-    {
-        curr = curr->next;
-        index++;
-    }
-    *rowP = curr->row;
-    *colP = curr->col;
+    int location = list->cells[rng_range(rng, list->length)]; // random index into the dense array
+    *rowP = location / MAX_BOARD_LENGTH;
+    *colP = location % MAX_BOARD_LENGTH;
     return 1; // random coordinates successfully found
 }
 
@@ -137,13 +105,10 @@ void empty_list_print(empty_list_t *list)
 {
     printf("List Length: %d\n", list->length);
     printf("INDEX ROW COL\n");
-    list_node_t *curr = list->front;
-    int index = 0;
-    while(curr != NULL)
+    for(int index = 0; index < list->length; index++)
     {
-        printf("%3d    %d   %d\n", index, curr->row, curr->col);
-        curr = curr->next;
-        index++;
+        int location = list->cells[index];
+        printf("%3d    %d   %d\n", index, location / MAX_BOARD_LENGTH, location % MAX_BOARD_LENGTH);
     }
 }
 
@@ -152,52 +117,101 @@ void empty_list_print(empty_list_t *list)
 ////////////////////////////////////
 
 /*
-    Allocates space for game struct 
-    Initializes fields of game struct
-    Allocates space for board and initializes its values
-    Allocates space for empty list and adds all the empty spaces to it
+    Allocates space for a size x size game with a single allocation
+    The game struct, its padded board and its empty list all live in one game_block_t
+    Initializes all of them through game_setup(), returns NULL if size is not supported
 */
-game_t *game_init()
+game_t *game_init(int size)
 {
-    game_t *game = malloc(sizeof(game_t));
+    if(size < MIN_BOARD_SIZE || size > MAX_BOARD_SIZE)
+    {
+        return NULL;
+    }
+    game_block_t *block = malloc(sizeof(game_block_t));
+    game_t *game = game_setup(block, size);
+    game_seed(game, ((uint64_t)rand() << 31) ^ rand()); // follows srand() unless game_seed() is called
+    return game;
+}
+
+/*
+    Points the game in a block at the block's own board and empty list, then resets it
+    Used by game_init() and by game pools, never allocates
+*/
+game_t *game_setup(game_block_t *block, int size)
+{
+    bitboard_init_tables(); // only built on the first call
+    game_t *game = &block->game;
+    game->size = size;
+    game->board = board_init(block->rows, block->cells, size);
+    game->empty_list = &block->empty_list;
+    game_reset(game);
+    return game;
+}
+
+/*
+    Reinitializes a game in place so it can be played again, without any allocator calls
+    Fields go back to their starting values, the board is emptied and every location is empty again
+    The random number generator keeps going so the next game is different
+*/
+void game_reset(game_t *game)
+{
+    game->bitboard = 0; // no tiles on the board yet
+    memset(game->line_moves, 0, sizeof(game->line_moves)); // nothing can move on an empty board
     game->points = 0;
     game->highest_tile = 0;
     game->game_status = INIT;
-    game->board = board_init(game);
-    game->empty_list = empty_list_init();
+    for(int row = START; row <= game->size; row++)
+    {
+        for(int col = START; col <= game->size; col++)
+        {
+            game->board[row][col] = EMPTY;
+        }
+    }
+    empty_list_reset(game->empty_list);
     empty_list_add_all(game);
-    return game;
 }
 
-// initializes the board associated with the game struct with EDGE & EMPTY spaces, returns the board at the end
-int **board_init()
+/*
+    Reseeds the random number generators of the game, the same seed and moves always give the same game
+    Policies draw from their own generator so the random tiles only depend on the seed and the moves
+*/
+void game_seed(game_t *game, uint64_t seed)
+{
+    rng_seed(&game->rng, seed);
+    rng_seed(&game->policy_rng, rng_mix_seed(seed, 1));
+}
+
+/*
+    Initializes a size x size board with EDGE & EMPTY spaces inside caller-provided storage
+    rows gets one pointer per row into cells ((size + 2) * (size + 2) ints), returns rows
+*/
+int **board_init(int **rows, int *cells, int size)
 {
-    int **board = malloc(sizeof(int) * BOARD_LENGTH * BOARD_LENGTH); // allocate space for rows
-    for(int row = 0; row < BOARD_LENGTH; row++)
+    int length = size + 2; // tiles plus the edge on both sides
+    for(int row = 0; row < length; row++)
     {
-        // allocate space for each set of columns
-        board[row] = malloc(sizeof(int) * BOARD_LENGTH);
-        for(int col = 0; col < BOARD_LENGTH; col++)
+        rows[row] = &cells[row * length];
+        for(int col = 0; col < length; col++)
         {
-            if(is_edge(row, col))
+            if(is_edge(size, row, col))
             {
-                board[row][col] = EDGE;
+                rows[row][col] = EDGE;
             }
             else
             {
-                board[row][col] = EMPTY;
+                rows[row][col] = EMPTY;
             }
         }
     }
-    return board;
+    return rows;
 }
 
 // adds all empty coordinates in the game struct to the game struct's list (upon initialization)
 void empty_list_add_all(game_t *game)
 {
-    for(int row = START; row <= END; row++)
+    for(int row = START; row <= game->size; row++)
     {
-        for(int col = START; col <= END; col++)
+        for(int col = START; col <= game->size; col++)
         {
             empty_list_add(game->empty_list, row, col);
         }
@@ -206,58 +220,186 @@ void empty_list_add_all(game_t *game)
 
 /*
     An edge is any location on the board
-    that is on the sides of the 2D array board
+    that is on the sides of the 2D array board,
+    a size x size board has its far edges at size + 1
 
-    returns 1 if row-col is edge, otherwise -
+    returns 1 if row-col is edge, otherwise 0
 */
-int is_edge(int row, int col)
+int is_edge(int size, int row, int col)
 {
-    if(row == EDGE_START || col == EDGE_START || row == EDGE_END || col == EDGE_END)
+    if(row == EDGE_START || col == EDGE_START || row == size + 1 || col == size + 1)
     {
         return 1;
     }
     return 0;
 }
 
-// frees all content of game struct, including board and empty_list
+// frees a game made by game_init(); board and empty_list share its single allocation
 void game_free(game_t *game)
 {
-    board_free(game);
-    empty_list_free(game->empty_list);
-    free(game);
+    free(game); // game is the first field of its game_block_t
+}
+
+////////////////////////////////
+// FUNCTIONS FOR GAME POOLS //
+//////////////////////////////
+
+/*
+    Allocates a pool of count size x size games in one contiguous block and sets every game up
+    After this, acquiring and releasing games never calls the allocator
+*/
+game_pool_t *game_pool_init(int count, int size)
+{
+    game_pool_t *pool = malloc(sizeof(game_pool_t));
+    pool->blocks = malloc(sizeof(game_block_t) * count);
+    pool->free_games = malloc(sizeof(game_t *) * count);
+    pool->capacity = count;
+    pool->free_count = count;
+    for(int index = 0; index < count; index++)
+    {
+        game_t *game = game_setup(&pool->blocks[index], size);
+        game_seed(game, index);
+        pool->free_games[index] = game;
+    }
+    return pool;
 }
 
-// frees all content of the board associated with the games; first all column sets and then the rows
-void board_free(game_t *game)
+// frees the pool and every game in it, games acquired from it must not be used afterwards
+void game_pool_free(game_pool_t *pool)
 {
-    for(int row = 0; row < BOARD_LENGTH; row++)
+    free(pool->blocks);
+    free(pool->free_games);
+    free(pool);
+}
+
+// takes a freshly reset game from the pool, returns NULL if every game is in use
+game_t *game_pool_acquire(game_pool_t *pool)
+{
+    if(pool->free_count == 0)
     {
-        free(game->board[row]);
+        return NULL;
     }
-    free(game->board);
+    game_t *game = pool->free_games[--pool->free_count];
+    game_reset(game);
+    return game;
+}
+
+// gives a game back to the pool it was acquired from
+void game_pool_release(game_pool_t *pool, game_t *game)
+{
+    pool->free_games[pool->free_count++] = game;
 }
 
 // prints game content (some content is only printed depending on parameter "logging")
 void game_print(game_t *game, int logging)
 {
-    // print game board, only print EDGES when logging
-    printf("\n");
-    for(int row = START; row <= END; row++)
+    INSTRUMENT_PHASE(PHASE_GAME_PRINT);
+    // build the board into one buffer so it is printed with a single call instead of one per cell
+    char buffer[512];
+    int length = sprintf(buffer, "\n");
+    for(int row = START; row <= game->size; row++)
     {
-        for(int col = START; col <= END; col++)
+        for(int col = START; col <= game->size; col++)
         {
-            printf("%6d", game->board[row][col]);
+            length += sprintf(buffer + length, "%6d", game->board[row][col]);
         }
-        printf("\n");
+        length += sprintf(buffer + length, "\n");
     }
-    printf("\n");
-    printf("points: %d\n", game->points);
-    printf("highest_tile: %d\n", game->highest_tile);
+    sprintf(buffer + length, "\npoints: %d\nhighest_tile: %d\n", game->points, game->highest_tile);
+    fputs(buffer, stdout);
     if(logging >= LOGGING)
     {
         printf("game status: %s\n", status_arr[game->game_status]);
         empty_list_print(game->empty_list);
     }
+    if(logging >= PROFILING) // live summary of the instrumentation counters
+    {
+        fflush(stdout);
+        instrument_dump(STDOUT_FILENO);
+    }
+}
+
+/*
+    Copies the tiles of the padded int board into the bitboard (4x4 games) and fixes up the empty list and move legality
+    Needed after tiles are edited directly through game->board or the cell-level functions (move_tile, swap_tiles...)
+*/
+void game_pack_board(game_t *game)
+{
+    board_t bitboard = 0;
+    for(int row = START; row <= game->size; row++)
+    {
+        for(int col = START; col <= game->size; col++)
+        {
+            if(game->size == BITBOARD_LENGTH)
+            {
+                bitboard = bitboard_set_tile(bitboard, row - START, col - START, game->board[row][col]);
+            }
+            if(game->board[row][col] == EMPTY && !empty_list_contains(game->empty_list, row, col))
+            {
+                empty_list_add(game->empty_list, row, col);
+            }
+            else if(game->board[row][col] != EMPTY)
+            {
+                empty_list_remove(game->empty_list, row, col);
+            }
+        }
+    }
+    if(game->size != BITBOARD_LENGTH)
+    {
+        grid_update_line_moves(game);
+        return;
+    }
+    game->bitboard = bitboard;
+    for(int dir = NORTH; dir <= WEST; dir++) // every cell may have changed, recompute all lines
+    {
+        game->line_moves[dir] = bitboard_line_moves(bitboard, dir);
+    }
+}
+
+/*
+    Replaces the bitboard of a 4x4 game with a new one
+    Move legality is only recomputed for the rows/cols that changed, then the int board is synced
+*/
+void game_set_bitboard(game_t *game, board_t bitboard)
+{
+    bitboard_update_line_moves(game->bitboard, bitboard, game->line_moves);
+    game->bitboard = bitboard;
+    game_unpack_board(game);
+}
+
+/*
+    Copies the tiles of the bitboard into the padded int board
+    Only cells that changed are written, and the empty list is updated for those cells only
+    Also updates the highest tile of the game
+*/
+void game_unpack_board(game_t *game)
+{
+    for(int row = START; row <= END; row++)
+    {
+        for(int col = START; col <= END; col++)
+        {
+            int value = bitboard_get_tile(game->bitboard, row - START, col - START);
+            if(game->board[row][col] == value)
+            {
+                continue;
+            }
+            if(value == EMPTY) // tile moved away from this location
+            {
+                empty_list_add(game->empty_list, row, col);
+            }
+            else if(game->board[row][col] == EMPTY) // tile moved into this location
+            {
+                empty_list_remove(game->empty_list, row, col);
+            }
+            game->board[row][col] = value;
+        }
+    }
+    //Highest tile should be updated if a merge or random tile is higher than the current highest
+    int highest = bitboard_highest_tile(game->bitboard);
+    if(highest > game->highest_tile)
+    {
+        game->highest_tile = highest;
+    }
 }
 
 ////////////////////////////////
@@ -265,9 +407,9 @@ void game_print(game_t *game, int logging)
 //////////////////////////////
 
 // picks either a tile of value 2 or 4 to place on the board (90% for 2, 10% for 4)
-int pick_random_tile()
+int pick_random_tile(rng_t *rng)
 {
-    int rand_index = rand() % 10;
+    int rand_index = rng_range(rng, 10);
     if(rand_index == SPECIAL)
     {
         return SPECIAL;
@@ -275,20 +417,30 @@ int pick_random_tile()
     return STANDARD;
 }
 
+/*
+    Places tile 2 or 4 at a random empty location
+    4x4 games place it on the bitboard and sync the int board, other sizes pick it from the empty list
+*/
 void place_random_tile(game_t *game)
 {
-    //Get a pair of row-col elements from the empty_list, remove from empty list
+    INSTRUMENT_PHASE(PHASE_PLACE_RANDOM_TILE);
+    if(game->size == BITBOARD_LENGTH)
+    {
+        game_set_bitboard(game, bitboard_place_random_tile(game->bitboard, &game->rng));
+        return;
+    }
     int row, col;
-    empty_list_get_random(game->empty_list, &row, &col);
+    if(!empty_list_get_random(game->empty_list, &game->rng, &row, &col))
+    {
+        return; // board is full
+    }
+    game->board[row][col] = pick_random_tile(&game->rng);
     empty_list_remove(game->empty_list, row, col);
-    //Add to the board
-    int rand_tile = pick_random_tile();
-    game->board[row][col] = rand_tile;
-    //Highest tile should be updated if the random tile is higher than the current highest
-    if(rand_tile > game->highest_tile)
+    if(game->board[row][col] > game->highest_tile)
     {
-        game->highest_tile = rand_tile;
+        game->highest_tile = game->board[row][col];
     }
+    grid_update_line_moves(game);
 }  
 
 ////////////////////////////////
@@ -323,65 +475,90 @@ int move_tile(game_t *game, int row, int col, int dir)
 // moves all tiles in one column in the north direction
 void move_col_north(game_t *game, int col)
 {
-    // traverse from top to bottom
-    for(int row = START; row <= END; row++)
+    if(game->size != BITBOARD_LENGTH)
     {
-        move_tile(game, row, col, NORTH);
+        grid_move_line(game, col - START, NORTH, &game->points);
+        grid_update_line_moves(game);
+        return;
     }
+    // the whole column is a single table lookup on the bitboard
+    game_set_bitboard(game, bitboard_move_line(game->bitboard, col - START, NORTH, &game->points));
 }
 
 // moves all tiles in one column in the south direction
 void move_col_south(game_t *game, int col)
 {
-    // traverse from bottom to top
-    for(int row = END; row >= START; row--)
+    if(game->size != BITBOARD_LENGTH)
     {
-        move_tile(game, row, col, SOUTH);
+        grid_move_line(game, col - START, SOUTH, &game->points);
+        grid_update_line_moves(game);
+        return;
     }
+    // the whole column is a single table lookup on the bitboard
+    game_set_bitboard(game, bitboard_move_line(game->bitboard, col - START, SOUTH, &game->points));
 }
 
 // moves all tiles in one row in the east direction
 void move_row_east(game_t *game, int row)
 {
-    // traverse from right to left
-    for(int col = END; col >= START; col--)
+    if(game->size != BITBOARD_LENGTH)
     {
-        move_tile(game, row, col, EAST);
+        grid_move_line(game, row - START, EAST, &game->points);
+        grid_update_line_moves(game);
+        return;
     }
+    // the whole row is a single table lookup on the bitboard
+    game_set_bitboard(game, bitboard_move_line(game->bitboard, row - START, EAST, &game->points));
 }
 
 // moves all tiles in one row in the west direction
 void move_row_west(game_t *game, int row)
 {
-    // traverse from left to right
-    for(int col = START; col <= END; col++)
+    if(game->size != BITBOARD_LENGTH)
     {
-        move_tile(game, row, col, WEST);
+        grid_move_line(game, row - START, WEST, &game->points);
+        grid_update_line_moves(game);
+        return;
     }
+    // the whole row is a single table lookup on the bitboard
+    game_set_bitboard(game, bitboard_move_line(game->bitboard, row - START, WEST, &game->points));
 }
 
-// moves all rows/columns depending on direction given
-void move_all(game_t *game, int dir)
+/*
+    Moves all rows/columns depending on direction given
+    4x4 games move on the bitboard through the successor cache and only sync the int board and empty list
+    if the board changed, other sizes move the int board with the kernel of their size
+
+    Returns 1 if the move changed the board, otherwise 0 (no random tile should be placed then)
+*/
+int move_all(game_t *game, int dir)
 {
-    for(int index = START; index <= END; index++)
+    INSTRUMENT_PHASE(PHASE_MOVE_ALL);
+    int moved;
+    if(game->size != BITBOARD_LENGTH)
     {
-        // determine which method to call using a switch statement
-        switch(dir)
-        {
-            case NORTH:
-                move_col_north(game, index);
-                break;
-            case SOUTH:
-                move_col_south(game, index);
-                break;
-            case EAST:
-                move_row_east(game, index);
-                break;
-            case WEST:
-                move_row_west(game, index);
-                break;
-        }
+        moved = grid_move(game, dir, 1, &game->points);
+        grid_update_line_moves(game);
+        return moved;
+    }
+    board_t bitboard = bitboard_move_cached(game->bitboard, dir, &game->points, &moved);
+    if(moved)
+    {
+        game_set_bitboard(game, bitboard);
     }
+    return moved;
+}
+
+// returns 1 if moving in dir changes the board and adds the points it would gain to *points, without moving
+int game_preview_move(game_t *game, int dir, int *points)
+{
+    if(game->size != BITBOARD_LENGTH)
+    {
+        return grid_move(game, dir, 0, points);
+    }
+    int moved;
+    bitboard_move_cached(game->bitboard, dir, points, &moved);
+    return moved;
 }
 
 ////////////////////////////////////////
@@ -391,6 +568,7 @@ void move_all(game_t *game, int dir)
 // swaps tile at row1, col1 to tile at row2, col2
 void swap_tiles(game_t *game, int row1, int col1, int row2, int col2)
 {
+    INSTRUMENT_PHASE(PHASE_SWAP_TILES);
     int temp = game->board[row1][col1];
     game->board[row1][col1] = game->board[row2][col2];
     game->board[row2][col2] = temp;
@@ -406,6 +584,7 @@ void swap_tiles(game_t *game, int row1, int col1, int row2, int col2)
 */
 int combine_tiles(game_t *game, int row1, int col1, int row2, int col2, int checking)
 {
+    INSTRUMENT_PHASE(PHASE_COMBINE_TILES);
     if(game->board[row1][col1] != game->board[row2][col2]) // cannot combine
     {
         return 0;
@@ -427,29 +606,34 @@ int combine_tiles(game_t *game, int row1, int col1, int row2, int col2, int chec
     return 1;
 }
 
-// checks if the game is still running by seeing if any tiles on the board can be combined with any adjacent tiles 
+/*
+    Checks if the game is still running by seeing if any direction can still change the board
+    Uses the cached per-line move legality, so this is O(1); an empty board still counts as running
+*/
 int game_running(game_t *game)
 {
-    if(game->empty_list->length != 0) // if there are empty tiles game is still running
-    {
-        return 1;
-    }
-    // loop through each row-col coordinate
-    for(int row = START; row <= END; row++)
+    INSTRUMENT_PHASE(PHASE_GAME_RUNNING);
+    if(game_legal_moves(game) != 0 || game->empty_list->length == game->size * game->size)
     {
-        for(int col = START; col <= END; col++)
-        {
-            // if non-zero that means combine_tiles succeeded for an adjacent tile
-            if(check_surrounding_tiles(game, row, col)) 
-            {
-                return 1; // game is not done
-            }
-        }
+        return 1; // game is not done
     }
     game->game_status = DONE;
     return 0; // game is done
 }
 
+// returns mask with bit dir set for every direction that changes the board, read from the cached line legality
+int game_legal_moves(game_t *game)
+{
+    return (game->line_moves[NORTH] != 0) << NORTH | (game->line_moves[SOUTH] != 0) << SOUTH |
+        (game->line_moves[EAST] != 0) << EAST | (game->line_moves[WEST] != 0) << WEST;
+}
+
+// returns 1 if moving in dir changes the board, otherwise 0
+int game_can_move(game_t *game, int dir)
+{
+    return game->line_moves[dir] != 0;
+}
+
 // checks all 4 surrounding tiles to this one and sees if any of them can be combined 
 int check_surrounding_tiles(game_t *game, int row, int col)
 {
@@ -461,17 +645,64 @@ int check_surrounding_tiles(game_t *game, int row, int col)
     return total;
 }
 
+//////////////////////////
+// FUNCTIONS FOR TIMING //
+////////////////////////
+
+// returns the current time in nanoseconds from a monotonic clock, every program times with this one
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 /////////////////////////////////////
 // FUNCTIONS FOR SETTING TERMINAL //
 ///////////////////////////////////
 
-// sets the terminal so user can sent input without needing to press "enter"
-void set_terminal(struct termios old, struct termios new)
+// terminal settings from before set_terminal(), restored on exit and on fatal signals
+static struct termios saved_terminal;
+static volatile sig_atomic_t terminal_saved = 0;
+
+// puts the terminal back the way it was before set_terminal(), safe to call more than once and from signal handlers
+void restore_terminal()
+{
+    if(terminal_saved)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_terminal);
+    }
+}
+
+// restores the terminal, then lets the signal do what it would have done
+static void restore_terminal_on_signal(int signal_number)
 {
-    tcgetattr(STDIN_FILENO, &old);
-    new = old;
+    restore_terminal();
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+/*
+    Sets the terminal so user can sent input without needing to press "enter"
+    The old settings are stored in *old and restored automatically on exit and on SIGINT/SIGTERM/SIGHUP/SIGQUIT
+*/
+void set_terminal(struct termios *old)
+{
+    if(tcgetattr(STDIN_FILENO, old) != 0)
+    {
+        return; // not a terminal (e.g. piped input), nothing to set or restore
+    }
+    saved_terminal = *old;
+    terminal_saved = 1;
+    atexit(restore_terminal);
+    int signals[4] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT};
+    for(int index = 0; index < 4; index++)
+    {
+        signal(signals[index], restore_terminal_on_signal);
+    }
+    struct termios new = *old;
     new.c_lflag &= (~ICANON & ~ECHO);
-    new.c_cc[VMIN] = 1; // one character allowed per loop
+    new.c_cc[VMIN] = 1; // reads wait for at least one character
     new.c_cc[VTIME] = 0;
     tcsetattr(STDIN_FILENO, TCSANOW, &new);
-}
\ No newline at end of file
+}
@@ -0,0 +1,174 @@
+#include "2048.h"
+
+/*
+    Move and game-over kernels for boards of any size
+
+    4x4 games run on the packed bitboard. Every other size runs on the padded int board,
+    with one set of kernels per size: each kernel is the generic routine below instantiated
+    by GRID_KERNELS(size) with the size as a compile-time constant, so the compiler can
+    unroll its loops. grid_move() and grid_update_line_moves() pick the kernel of the game.
+
+    Lines are walked from the cell tiles slide towards, so one routine handles every direction:
+    step k of line i is the cell at grid_cell() below.
+*/
+
+// returns the cell of the padded board at the given step of a line, walking the line in sliding order
+static inline __attribute__((always_inline)) int *grid_cell(game_t *game, int size, int dir, int line, int step)
+{
+    switch(dir)
+    {
+        case NORTH:
+            return &game->board[START + step][START + line];
+        case SOUTH:
+            return &game->board[size - step][START + line];
+        case EAST:
+            return &game->board[START + line][size - step];
+        default: // WEST
+            return &game->board[START + line][START + step];
+    }
+}
+
+/*
+    Slides and merges lines [first, last) of the board in dir, only writing the board when apply is set
+    Cells that change are written once and the empty list is updated for those cells only
+
+    Returns 1 if any tile moved or merged, points gained are added to *points
+*/
+static inline __attribute__((always_inline)) int grid_move_generic(game_t *game, int size, int dir, int first, int last,
+    int apply, int *points)
+{
+    int moved = 0;
+    for(int line = first; line < last; line++)
+    {
+        int tiles[MAX_BOARD_SIZE];
+        int count = 0;
+        for(int step = 0; step < size; step++) // gather the tiles of the line in sliding order
+        {
+            int value = *grid_cell(game, size, dir, line, step);
+            if(value != EMPTY)
+            {
+                tiles[count++] = value;
+            }
+        }
+        int result[MAX_BOARD_SIZE] = {0};
+        int length = 0;
+        for(int index = 0; index < count; index++) // each tile merges at most once
+        {
+            if(index + 1 < count && tiles[index] == tiles[index + 1])
+            {
+                result[length++] = tiles[index] * 2;
+                *points += tiles[index] * 2;
+                index++;
+            }
+            else
+            {
+                result[length++] = tiles[index];
+            }
+        }
+        for(int step = 0; step < size; step++) // write back only the cells that changed
+        {
+            int *cell = grid_cell(game, size, dir, line, step);
+            if(*cell == result[step])
+            {
+                continue;
+            }
+            moved = 1;
+            if(!apply)
+            {
+                break;
+            }
+            int row = (cell - game->board[0]) / (size + 2);
+            int col = (cell - game->board[0]) % (size + 2);
+            if(result[step] == EMPTY)
+            {
+                empty_list_add(game->empty_list, row, col);
+            }
+            else if(*cell == EMPTY)
+            {
+                empty_list_remove(game->empty_list, row, col);
+            }
+            *cell = result[step];
+            if(result[step] > game->highest_tile)
+            {
+                game->highest_tile = result[step];
+            }
+        }
+    }
+    return moved;
+}
+
+// recomputes, for every direction, which lines have a tile that can slide into a gap or merge with its neighbour
+static inline __attribute__((always_inline)) void grid_line_moves_generic(game_t *game, int size)
+{
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        uint8_t mask = 0;
+        for(int line = 0; line < size; line++)
+        {
+            for(int step = 0; step + 1 < size; step++)
+            {
+                int first = *grid_cell(game, size, dir, line, step);
+                int second = *grid_cell(game, size, dir, line, step + 1);
+                if(second != EMPTY && (first == EMPTY || first == second))
+                {
+                    mask |= 1 << line;
+                    break;
+                }
+            }
+        }
+        game->line_moves[dir] = mask;
+    }
+}
+
+// instantiates the kernels of one board size
+#define GRID_KERNELS(N) \
+    static int grid_move_##N(game_t *game, int dir, int first, int last, int apply, int *points) \
+    { \
+        return grid_move_generic(game, N, dir, first, last, apply, points); \
+    } \
+    static void grid_line_moves_##N(game_t *game) \
+    { \
+        grid_line_moves_generic(game, N); \
+    }
+
+GRID_KERNELS(3)
+GRID_KERNELS(4)
+GRID_KERNELS(5)
+GRID_KERNELS(6)
+
+// kernels of every supported size, indexed by size
+static struct
+{
+    int (*move)(game_t *game, int dir, int first, int last, int apply, int *points);
+    void (*line_moves)(game_t *game);
+}
+grid_kernels[MAX_BOARD_SIZE + 1] =
+{
+    [3] = {grid_move_3, grid_line_moves_3},
+    [4] = {grid_move_4, grid_line_moves_4},
+    [5] = {grid_move_5, grid_line_moves_5},
+    [6] = {grid_move_6, grid_line_moves_6},
+};
+
+/*
+    Moves every line of the game's padded board in dir with the kernel of its size
+    The board is only changed when apply is set, so the same call previews a move
+
+    Returns 1 if the move changes the board, points gained are added to *points
+*/
+int grid_move(game_t *game, int dir, int apply, int *points)
+{
+    return grid_kernels[game->size].move(game, dir, 0, game->size, apply, points);
+}
+
+// moves one row (EAST/WEST) or col (NORTH/SOUTH) of the padded board, index counts from 0, returns 1 if it changed
+int grid_move_line(game_t *game, int index, int dir, int *points)
+{
+    return grid_kernels[game->size].move(game, dir, index, index + 1, 1, points);
+}
+
+// recomputes the per-line move legality of the game's padded board with the kernel of its size
+void grid_update_line_moves(game_t *game)
+{
+    grid_kernels[game->size].line_moves(game);
+}
@@ -0,0 +1,139 @@
+#include "2048.h"
+
+/*
+    Undo/redo history of the interactive game
+
+    Every turn is kept as one fixed-size snapshot (game_snapshot_t, 72 bytes): one tile
+    exponent per byte (5x5 and 6x6 boards can hold tiles past 2^15, which a nibble cannot),
+    the points and the tile generator. Snapshots live in a ring buffer indexed by turn, so
+    recording, undoing and redoing are all O(1) and never allocate; a 20000-move game takes
+    1.4 MB.
+
+    Restoring writes the cells back into the padded board and rebuilds the bitboard, the
+    empty list and the move legality from them, no moves are replayed. Since the generator
+    is restored too, undoing a move and making it again spawns the same tile on 4x4 boards
+    (other sizes pick from the empty list, whose order is not kept).
+*/
+
+// returns the log2 exponent of a tile value, EMPTY stays 0
+static int tile_exponent(int value)
+{
+    return value == EMPTY ? 0 : __builtin_ctz(value);
+}
+
+// records the tiles, points and tile generator of the game
+void game_snapshot(game_t *game, game_snapshot_t *snapshot)
+{
+    memset(snapshot->cells, 0, sizeof(snapshot->cells));
+    for(int row = 0; row < game->size; row++)
+    {
+        for(int col = 0; col < game->size; col++)
+        {
+            snapshot->cells[row * game->size + col] = tile_exponent(game->board[START + row][START + col]);
+        }
+    }
+    snapshot->points = game->points;
+    snapshot->rng = game->rng;
+}
+
+/*
+    Puts the game back to a snapshot of a game of the same size
+    The cells are written into the padded board and the empty list, bitboard and move legality are rebuilt from them,
+    the highest tile is the biggest tile of the snapshot since tiles only ever merge into bigger ones
+*/
+void game_restore(game_t *game, game_snapshot_t *snapshot)
+{
+    empty_list_reset(game->empty_list);
+    game->highest_tile = 0;
+    for(int row = 0; row < game->size; row++)
+    {
+        for(int col = 0; col < game->size; col++)
+        {
+            int exponent = snapshot->cells[row * game->size + col];
+            int value = exponent == 0 ? EMPTY : 1 << exponent;
+            game->board[START + row][START + col] = value;
+            if(exponent == 0)
+            {
+                empty_list_add(game->empty_list, START + row, START + col);
+            }
+            if(value > game->highest_tile)
+            {
+                game->highest_tile = value;
+            }
+        }
+    }
+    game_pack_board(game); // the empty list is already right, this rebuilds the bitboard and move legality
+    game->points = snapshot->points;
+    game->rng = snapshot->rng;
+}
+
+// allocates an empty history, the struct and every snapshot slot in one allocation
+game_history_t *history_init()
+{
+    game_history_t *history = calloc(1, sizeof(game_history_t) + HISTORY_CAPACITY * sizeof(game_snapshot_t));
+    if(history == NULL)
+    {
+        return NULL;
+    }
+    history->snapshots = (game_snapshot_t *)(history + 1);
+    return history;
+}
+
+void history_free(game_history_t *history)
+{
+    free(history);
+}
+
+// returns the slot of a turn
+static game_snapshot_t *history_slot(game_history_t *history, long turn)
+{
+    return &history->snapshots[turn % HISTORY_CAPACITY];
+}
+
+// forgets every turn, the current state of the game becomes turn 0
+void history_reset(game_history_t *history, game_t *game)
+{
+    history->oldest = 0;
+    history->current = 0;
+    history->newest = 0;
+    game_snapshot(game, history_slot(history, 0));
+}
+
+/*
+    Records the current state of the game as a new turn after the current one
+    Turns that were undone can no longer be redone, and the oldest turn is dropped once the ring is full
+*/
+void history_record(game_history_t *history, game_t *game)
+{
+    history->current++;
+    history->newest = history->current;
+    if(history->current - history->oldest >= HISTORY_CAPACITY)
+    {
+        history->oldest++;
+    }
+    game_snapshot(game, history_slot(history, history->current));
+}
+
+// puts the game back one turn, returns 0 if no older turn is kept
+int history_undo(game_history_t *history, game_t *game)
+{
+    if(history->current == history->oldest)
+    {
+        return 0;
+    }
+    history->current--;
+    game_restore(game, history_slot(history, history->current));
+    return 1;
+}
+
+// puts the game forward one undone turn, returns 0 if there is none
+int history_redo(game_history_t *history, game_t *game)
+{
+    if(history->current == history->newest)
+    {
+        return 0;
+    }
+    history->current++;
+    game_restore(game, history_slot(history, history->current));
+    return 1;
+}
@@ -0,0 +1,75 @@
+#include "2048.h"
+
+/*
+    Non-blocking keyboard input for the interactive program
+
+    input_read_keys() waits with poll() until a key is available (or the timeout passes),
+    then reads every key that is already pending in one go. The game loop applies all
+    queued keys as one batch and only draws the final position, so keys typed ahead are
+    never dropped and the screen never falls behind the keyboard by more than one batch.
+*/
+
+// returns the direction moved by a key (W/A/S/D in either case), -1 for any other key
+int key_to_dir(int key)
+{
+    switch(tolower(key))
+    {
+        case 'w':
+            return NORTH;
+        case 'a':
+            return WEST;
+        case 's':
+            return SOUTH;
+        case 'd':
+            return EAST;
+    }
+    return -1;
+}
+
+// returns the oldest queued key, -1 if the queue is empty
+int key_queue_pop(key_queue_t *queue)
+{
+    if(queue->count == 0)
+    {
+        return -1;
+    }
+    int key = queue->keys[queue->head];
+    queue->head = (queue->head + 1) % KEY_QUEUE_CAPACITY;
+    queue->count--;
+    return key;
+}
+
+// drops every queued key
+void key_queue_clear(key_queue_t *queue)
+{
+    queue->head = 0;
+    queue->count = 0;
+}
+
+/*
+    Waits up to timeout_ms for input (-1 waits forever, 0 only takes keys already pending)
+    and moves every pending key into the queue, keys that do not fit stay pending for the next call
+
+    Returns the amount of keys queued, or -1 once the input has ended
+*/
+int input_read_keys(key_queue_t *queue, int timeout_ms)
+{
+    struct pollfd input = {.fd = STDIN_FILENO, .events = POLLIN};
+    int queued = 0;
+    while(queue->count < KEY_QUEUE_CAPACITY && poll(&input, 1, queued == 0 ? timeout_ms : 0) > 0)
+    {
+        unsigned char keys[KEY_QUEUE_CAPACITY];
+        ssize_t length = read(STDIN_FILENO, keys, KEY_QUEUE_CAPACITY - queue->count);
+        if(length <= 0)
+        {
+            return queued > 0 ? queued : -1; // end of input (or a read error), report it once the queue is used up
+        }
+        for(int index = 0; index < length; index++)
+        {
+            queue->keys[(queue->head + queue->count) % KEY_QUEUE_CAPACITY] = keys[index];
+            queue->count++;
+        }
+        queued += length;
+    }
+    return queued;
+}
@@ -0,0 +1,162 @@
+#include "2048.h"
+#include <stdatomic.h>
+
+/*
+    Hot-path instrumentation: call counts, cycle timers and allocations per phase
+
+    Only compiled in when INSTRUMENT is defined ("make INSTRUMENT=1"). The instrumented
+    build also wraps malloc/calloc/realloc/free at link time (-Wl,--wrap=...) so every
+    phase can count the allocations made while it ran.
+
+    Counters are shared by every thread and updated with relaxed atomics. They are written
+    to stderr when the program exits, and whenever the process gets SIGUSR1
+    (kill -USR1 <pid>), so a long game or simulation can be looked at while it runs.
+*/
+
+static char *phase_names[PHASE_COUNT] =
+{
+    "move_all", "swap_tiles", "combine_tiles", "place_random_tile", "game_running", "game_print",
+};
+
+#ifdef INSTRUMENT
+
+// counters of one phase
+typedef struct
+{
+    _Atomic uint64_t calls;
+    _Atomic uint64_t cycles; // total cycles spent in the phase
+    _Atomic uint64_t max_cycles; // longest single call
+    _Atomic uint64_t allocs; // allocations made during the phase
+}
+phase_stats_t;
+
+static phase_stats_t phase_stats[PHASE_COUNT];
+
+__thread long instrument_thread_allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void __real_free(void *pointer);
+
+void *__wrap_malloc(size_t size)
+{
+    instrument_thread_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    instrument_thread_allocs++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    instrument_thread_allocs++;
+    return __real_realloc(pointer, size);
+}
+
+void __wrap_free(void *pointer)
+{
+    __real_free(pointer);
+}
+
+// returns the cycle counter, or nanoseconds where there is no cycle counter to read
+static uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// starts timing a phase, used through INSTRUMENT_PHASE()
+phase_timer_t instrument_begin(int phase)
+{
+    phase_timer_t timer = {.phase = phase, .start = read_cycles(), .allocs = instrument_thread_allocs};
+    return timer;
+}
+
+// adds the cycles and allocations since instrument_begin() to the phase, called when the timed function returns
+void instrument_end(phase_timer_t *timer)
+{
+    uint64_t cycles = read_cycles() - timer->start;
+    phase_stats_t *stats = &phase_stats[timer->phase];
+    atomic_fetch_add_explicit(&stats->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->cycles, cycles, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->allocs, instrument_thread_allocs - timer->allocs, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&stats->max_cycles, memory_order_relaxed);
+    while(cycles > max && !atomic_compare_exchange_weak(&stats->max_cycles, &max, cycles));
+}
+
+/*
+    Writes one line per phase with its call count, total/mean/max cycles and allocations
+    Only formats into a stack buffer and calls write(), so it can also run from the SIGUSR1 handler
+*/
+void instrument_dump(int fd)
+{
+    char buffer[1024];
+    int length = snprintf(buffer, sizeof(buffer), "%-18s %12s %16s %10s %12s %8s\n",
+        "PHASE", "CALLS", "CYCLES", "MEAN", "MAX", "ALLOCS");
+    for(int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        phase_stats_t *stats = &phase_stats[phase];
+        uint64_t calls = atomic_load(&stats->calls);
+        uint64_t cycles = atomic_load(&stats->cycles);
+        length += snprintf(buffer + length, sizeof(buffer) - length, "%-18s %12llu %16llu %10.1f %12llu %8llu\n",
+            phase_names[phase], (unsigned long long)calls, (unsigned long long)cycles, calls ? (double)cycles / calls : 0.0,
+            (unsigned long long)atomic_load(&stats->max_cycles), (unsigned long long)atomic_load(&stats->allocs));
+    }
+    if(write(fd, buffer, length) < 0)
+    {
+        return; // nowhere left to report it
+    }
+}
+
+// sets every counter back to 0
+void instrument_reset()
+{
+    for(int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        atomic_store(&phase_stats[phase].calls, 0);
+        atomic_store(&phase_stats[phase].cycles, 0);
+        atomic_store(&phase_stats[phase].max_cycles, 0);
+        atomic_store(&phase_stats[phase].allocs, 0);
+    }
+}
+
+static void dump_on_exit()
+{
+    instrument_dump(STDERR_FILENO);
+}
+
+static void dump_on_signal(int signal_number)
+{
+    instrument_dump(STDERR_FILENO);
+}
+
+// registers the exit and SIGUSR1 dumps before main() runs, so every program gets them without any setup
+__attribute__((constructor)) static void instrument_install()
+{
+    atexit(dump_on_exit);
+    signal(SIGUSR1, dump_on_signal);
+}
+
+#else
+
+// instrumentation is not compiled in, say how to get it
+void instrument_dump(int fd)
+{
+    dprintf(fd, "instrumentation is off, build with \"make INSTRUMENT=1\" to count %s and the other phases\n",
+        phase_names[PHASE_MOVE_ALL]);
+}
+
+void instrument_reset()
+{
+}
+
+#endif
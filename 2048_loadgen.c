@@ -0,0 +1,244 @@
+#include "2048.h"
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+    Load generator for the game server
+
+    Every client thread opens its own connection and plays whole games through it: a
+    SERVER_NEW_GAME, then SERVER_MOVE requests (or SERVER_BATCH requests of batch moves)
+    in random directions until the game is over, then SERVER_CLOSE. Each request waits for
+    its response, so the time of each round trip is the latency of one request.
+
+    Each client also plays every game locally with the same seed and moves, and checks
+    every response against it, so a run doubles as a test of the server.
+
+    usage: ./loadgen [socket] [clients] [games] [batch] [seed]
+    games is the amount of games each client plays, batch 0 sends single moves
+*/
+
+#define MAX_CLIENTS     256
+#define MAX_LATENCIES   (1 << 20) // round trips timed by each client, later ones are not timed
+
+// state and counters of one client thread
+typedef struct
+{
+    pthread_t thread;
+    int id;
+    long games;
+    long moves; // moves sent, including ones that did not change the board
+    long requests;
+    long mismatches; // responses that do not match the local game
+    long failures; // requests the server did not answer with SERVER_OK
+    long *latencies; // nanoseconds of each timed round trip
+    long timed;
+}
+load_client_t;
+
+static char *socket_path;
+static long games_per_client;
+static int batch_size;
+static uint64_t seed;
+
+// writes or reads all length bytes, returns 0 if the connection failed
+static int send_all(int fd, void *bytes, size_t length)
+{
+    for(size_t done = 0; done < length;)
+    {
+        ssize_t written = write(fd, (char *)bytes + done, length - done);
+        if(written <= 0)
+        {
+            return 0;
+        }
+        done += written;
+    }
+    return 1;
+}
+
+static int receive_all(int fd, void *bytes, size_t length)
+{
+    for(size_t done = 0; done < length;)
+    {
+        ssize_t received = read(fd, (char *)bytes + done, length - done);
+        if(received <= 0)
+        {
+            return 0;
+        }
+        done += received;
+    }
+    return 1;
+}
+
+// sends one request of length bytes and waits for its response, timing the round trip, returns 0 if the connection failed
+static int round_trip(load_client_t *client, int fd, void *request, size_t length, server_response_t *response)
+{
+    long start = now_ns();
+    if(!send_all(fd, request, length) || !receive_all(fd, response, sizeof(*response)))
+    {
+        return 0;
+    }
+    if(client->timed < MAX_LATENCIES)
+    {
+        client->latencies[client->timed++] = now_ns() - start;
+    }
+    client->requests++;
+    client->failures += response->status != SERVER_OK;
+    return 1;
+}
+
+// moves the local game the way the server does, returns 1 if the board changed
+static int local_move(game_t *game, int dir)
+{
+    if(!game_running(game) || !move_all(game, dir))
+    {
+        return 0;
+    }
+    place_random_tile(game);
+    return 1;
+}
+
+// returns 1 if a response shows the same game as the local one
+static int matches(server_response_t *response, game_t *game)
+{
+    return response->board == game->bitboard && response->points == (uint32_t)game->points &&
+        response->highest_tile == (uint32_t)game->highest_tile && response->running == game_running(game);
+}
+
+// thread body: plays games_per_client games through one connection, checking each against a local copy
+static void *load_client_run(void *argument)
+{
+    load_client_t *client = argument;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    if(fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("cannot connect");
+        client->failures++;
+        return NULL;
+    }
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
+    rng_t rng; // picks the directions
+    rng_seed(&rng, rng_mix_seed(seed, client->id + MAX_CLIENTS));
+    uint8_t request[sizeof(server_request_t) + SERVER_MAX_BATCH];
+    server_response_t response;
+    for(long index = 0; index < games_per_client; index++)
+    {
+        uint64_t game_seed_value = rng_mix_seed(seed, client->id * games_per_client + index);
+        server_request_t head = {.type = SERVER_NEW_GAME};
+        memcpy(request, &head, sizeof(head));
+        memcpy(request + sizeof(head), &game_seed_value, sizeof(game_seed_value));
+        if(!round_trip(client, fd, request, sizeof(head) + sizeof(game_seed_value), &response))
+        {
+            break;
+        }
+        uint32_t session = response.session;
+        game_reset(game);
+        game_seed(game, game_seed_value);
+        place_random_tile(game);
+        place_random_tile(game);
+        client->mismatches += !matches(&response, game);
+        while(response.status == SERVER_OK && response.running)
+        {
+            head = (server_request_t){.type = batch_size > 0 ? SERVER_BATCH : SERVER_MOVE, .session = session};
+            int moves = batch_size > 0 ? batch_size : 1;
+            int moved = 0;
+            for(int move = 0; move < moves; move++)
+            {
+                int dir = rng_range(&rng, 4);
+                request[sizeof(head) + move] = dir;
+                head.dir = dir;
+                moved += local_move(game, dir);
+            }
+            head.count = batch_size;
+            memcpy(request, &head, sizeof(head));
+            if(!round_trip(client, fd, request, sizeof(head) + batch_size, &response))
+            {
+                break;
+            }
+            client->moves += moves;
+            client->mismatches += !matches(&response, game) || response.moved != moved;
+        }
+        head = (server_request_t){.type = SERVER_CLOSE, .session = session};
+        if(!round_trip(client, fd, &head, sizeof(head), &response))
+        {
+            break;
+        }
+        client->games++;
+    }
+    game_free(game);
+    close(fd);
+    return NULL;
+}
+
+// comparison function for sorting latencies with qsort
+static int compare_longs(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+    This main method runs the client threads
+    against a running ./server and prints the
+    throughput and latency of the requests
+*/
+int main(int argc, char **argv)
+{
+    socket_path = argc > 1 ? argv[1] : SERVER_SOCKET_PATH;
+    int client_count = argc > 2 ? atoi(argv[2]) : 4;
+    games_per_client = argc > 3 ? atol(argv[3]) : 100;
+    batch_size = argc > 4 ? atoi(argv[4]) : 0;
+    seed = argc > 5 ? strtoull(argv[5], NULL, 10) : 1;
+    if(client_count <= 0 || client_count > MAX_CLIENTS || games_per_client <= 0 || batch_size < 0 || batch_size > SERVER_MAX_BATCH)
+    {
+        printf("usage: %s [socket] [clients (1 to %d)] [games] [batch (0 to %d)] [seed]\n", argv[0], MAX_CLIENTS, SERVER_MAX_BATCH);
+        return 1;
+    }
+    bitboard_init_tables();
+    load_client_t *clients = calloc(client_count, sizeof(load_client_t));
+    for(int id = 0; id < client_count; id++)
+    {
+        clients[id].id = id;
+        clients[id].latencies = malloc(MAX_LATENCIES * sizeof(long));
+    }
+    long start = now_ns();
+    for(int id = 0; id < client_count; id++)
+    {
+        pthread_create(&clients[id].thread, NULL, load_client_run, &clients[id]);
+    }
+    load_client_t total = {0};
+    for(int id = 0; id < client_count; id++)
+    {
+        pthread_join(clients[id].thread, NULL);
+        total.games += clients[id].games;
+        total.moves += clients[id].moves;
+        total.requests += clients[id].requests;
+        total.mismatches += clients[id].mismatches;
+        total.failures += clients[id].failures;
+        total.timed += clients[id].timed;
+    }
+    long *latencies = malloc((total.timed + 1) * sizeof(long));
+    for(long id = 0, offset = 0; id < client_count; id++)
+    {
+        memcpy(latencies + offset, clients[id].latencies, clients[id].timed * sizeof(long));
+        offset += clients[id].timed;
+        free(clients[id].latencies);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    printf("clients: %d, games: %ld, moves: %ld, requests: %ld in %.3f seconds\n", client_count, total.games,
+        total.moves, total.requests, seconds);
+    printf("moves/sec: %.1f, requests/sec: %.1f\n", total.moves / seconds, total.requests / seconds);
+    if(total.timed > 0)
+    {
+        qsort(latencies, total.timed, sizeof(long), compare_longs);
+        printf("latency (us): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", latencies[total.timed / 2] / 1e3,
+            latencies[total.timed * 9 / 10] / 1e3, latencies[total.timed * 99 / 100] / 1e3, latencies[total.timed - 1] / 1e3);
+    }
+    printf("mismatches: %ld, failed requests: %ld\n", total.mismatches, total.failures);
+    free(latencies);
+    free(clients);
+    return total.mismatches != 0 || total.failures != 0;
+}
@@ -9,83 +9,201 @@
     The game is implemented in methods written
     in the "2048_funcs.c" file, with the header
     file being located in "2048.h"
+
+    Running "./program [size]" plays on a size x size
+    board (3 to 6, default 4)
+
+    Running "./program ai [ms] [threads]" lets the
+    expectimax AI play instead, searching each move
+    for the given amount of milliseconds (default 100)
+    on the given amount of threads (default all cores)
+
+    Running "./program rollout [playouts] [ms] [threads]"
+    lets the Monte Carlo rollout player play, with
+    that many random playouts per direction of each
+    move (0 for no limit, default 256), a time limit
+    per move (default none) and the amount of threads
+
+    Running "./program ntuple [weights]" lets the
+    n-tuple network trained by "./train" play, with
+    its weights mapped from the given file (default
+    "ntuple.weights")
+
+    The board is redrawn in place by the renderer
+    ("2048_render.c"), AI play is drawn at RENDER_FPS
+
+    Keys are read without blocking ("2048_input.c")
+    and every key typed ahead is applied before
+    the next frame is drawn
+
+    Every turn is kept in an undo/redo history
+    ("2048_history.c"), U takes a move back and
+    Y makes it again, also after the game is lost
 */
 int main(int argc, char **argv)
 {
-    // how-to-play
-    printf("\nW --> Move Tiles Up\n");
-    printf("A --> Move Tiles Left\n");
-    printf("S --> Move Tiles Down\n");
-    printf("D --> Move Tiles Right\n");
-    printf("Q --> Quit\n");
-    printf("R --> Restart\n");
-
-    // set terminal & rand generator
-    struct termios old, new;
-    set_terminal(old, new);
+    int rollout_mode = argc > 1 && strcmp(argv[1], "rollout") == 0;
+    int ntuple_mode = argc > 1 && strcmp(argv[1], "ntuple") == 0;
+    int ai_mode = rollout_mode || ntuple_mode || (argc > 1 && strcmp(argv[1], "ai") == 0);
+    move_policy_t ai_policy = rollout_mode ? policy_rollout : ntuple_mode ? policy_ntuple : policy_expectimax;
+    int size = argc > 1 && isdigit(argv[1][0]) ? atoi(argv[1]) : DEFAULT_BOARD_SIZE;
+    game_t *game = game_init(size);
+    if(game == NULL)
+    {
+        printf("usage: %s [size (%d to %d)] | %s ai [ms] [threads] | %s rollout [playouts] [ms] [threads] | %s ntuple [weights]\n",
+            argv[0], MIN_BOARD_SIZE, MAX_BOARD_SIZE, argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if(ntuple_mode && !ntuple_use_weights(argc > 2 ? argv[2] : NTUPLE_DEFAULT_PATH))
+    {
+        printf("cannot map %s, train weights with ./train first\n", argc > 2 ? argv[2] : NTUPLE_DEFAULT_PATH);
+        game_free(game);
+        return 1;
+    }
+    if(rollout_mode) // play out each move on every core
+    {
+        rollout_set_budget(argc > 2 ? atoi(argv[2]) : ROLLOUT_DEFAULT_PLAYOUTS, argc > 3 ? atoi(argv[3]) : 0);
+        rollout_set_threads(argc > 4 ? atoi(argv[4]) : (int)sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    else if(ai_policy == policy_expectimax && ai_mode) // search each move on every core
+    {
+        if(argc > 2)
+        {
+            ai_set_time_budget(atoi(argv[2]));
+        }
+        eval_load_weights("weights.cfg"); // built-in weights are kept if there is no config file
+        ai_set_threads(argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN));
+    }
+
+    // how-to-play, drawn above the board by the renderer
+    static renderer_t renderer;
+    render_init(&renderer, "\nW --> Move Tiles Up\n"
+        "A --> Move Tiles Left\n"
+        "S --> Move Tiles Down\n"
+        "D --> Move Tiles Right\n"
+        "U --> Undo Move\n"
+        "Y --> Redo Move\n"
+        "Q --> Quit\n"
+        "R --> Restart\n", RENDER_FPS);
+    game_history_t *history = history_init();
+
+    // set terminal & rand generator, the terminal is restored on exit and on signals
+    struct termios old;
+    set_terminal(&old);
     srand(time(NULL));
+    game_seed(game, ((uint64_t)rand() << 31) ^ rand()); // the game was created before srand()
+    key_queue_t keys = {0};
+    int quit = 0;
+    int won_prompt = 0; // set while waiting for the key that answers the 2048 message
+    int won_shown = 0; // the 2048 message is only shown once per game
 
 GAME_INIT: 
-    game_t *game = game_init();
-    place_random_tile(game); // place an initial random tile
+    place_random_tile(game); // place the two initial random tiles
+    place_random_tile(game);
+    won_shown = 0;
+    history_reset(history, game);
 
-    while(game_running(game)) // run until the game cannot continue
+GAME_LOOP:
+    while(!quit && game_running(game)) // run until the game cannot continue
     {
         game->game_status = RUNNING;
-        place_random_tile(game);
-        game_print(game, NO_LOG); 
-        printf("\n");
+        render_frame(&renderer, game, !ai_mode); // AI frames past the fps cap are skipped
 
-GET_INPUT: 
-        int move = getchar(); // obtain move from player
-        if(tolower(move) == 'w') // move up
+        // wait for keys (AI play only takes keys already typed) and apply them all before drawing again
+        if(input_read_keys(&keys, ai_mode ? 0 : -1) < 0 && !ai_mode)
         {
-            move_all(game, NORTH);
+            break; // input ended
         }
-        else if(tolower(move) == 'a') // move left
+        int key;
+        while(!quit && game_running(game) && (key = key_queue_pop(&keys)) >= 0)
         {
-            move_all(game, WEST);
-        }
-        else if(tolower(move) == 's') // move down
-        {
-            move_all(game, SOUTH);
-        }
-        else if(tolower(move) == 'd') // move right
-        {
-            move_all(game, EAST);
-        }
-        else if(tolower(move) == 'q')
-        {
-            break;
+            if(tolower(key) == 'q')
+            {
+                quit = 1;
+            }
+            else if(won_prompt) // any other key answers the 2048 message and keeps playing
+            {
+                won_prompt = 0;
+                render_message(&renderer, "");
+            }
+            else if(tolower(key) == 'r')
+            {
+                game_reset(game); // reinitialize in place, no need to free and allocate again
+                key_queue_clear(&keys); // keys typed before the restart were meant for the old game
+                render_message(&renderer, "Game restarting...");
+                goto GAME_INIT; // explicit jump to reinitialize the game
+            }
+            else if(!ai_mode && key_to_dir(key) >= 0) // W/A/S/D move up/left/down/right
+            {
+                if(move_all(game, key_to_dir(key))) // a move that changes nothing does not add a tile
+                {
+                    place_random_tile(game);
+                    history_record(history, game);
+                }
+                render_message(&renderer, "");
+            }
+            else if(!ai_mode && tolower(key) == 'u')
+            {
+                render_message(&renderer, history_undo(history, game) ? "" : "There is no move left to undo.");
+            }
+            else if(!ai_mode && tolower(key) == 'y')
+            {
+                render_message(&renderer, history_redo(history, game) ? "" : "There is no move left to redo.");
+            }
+            else if(!ai_mode)
+            {
+                render_message(&renderer, "Sorry, your input was invalid, try again...");
+            }
+
+            // if the user reaches 2048 show a special message and wait for an answer
+            if(!ai_mode && !won_shown && game->highest_tile == 2048)
+            {
+                render_message(&renderer, "You've won! You've reached the tile 2048! Press Q to quit, any other character to continue: ");
+                key_queue_clear(&keys); // keys typed ahead should not answer a message the user has not seen
+                won_prompt = 1;
+                won_shown = 1;
+            }
         }
-        else if(tolower(move) == 'r')
+
+        if(ai_mode && !quit && game_running(game)) // the AI picks the move, no input is needed
         {
-            game_free(game);
-            printf("\nGame restarting...\n");
-            goto GAME_INIT; // explicit jump to reinitialize the game
+            if(move_all(game, ai_policy(game)))
+            {
+                place_random_tile(game);
+            }
+            if(rollout_mode) // shows how much playing strength the CPU time buys
+            {
+                long playouts;
+                double seconds;
+                char message[RENDER_MESSAGE_SIZE];
+                rollout_stats(&playouts, &seconds);
+                snprintf(message, sizeof(message), "rollouts/sec: %.0f", seconds > 0.0 ? playouts / seconds : 0.0);
+                render_message(&renderer, message);
+            }
         }
-        else
+    }
+    // a lost game can still be taken back
+    if(!quit && !ai_mode && !game_running(game) && history->current != history->oldest)
+    {
+        render_message(&renderer, "No moves left! Press U to undo, any other character to quit: ");
+        render_frame(&renderer, game, 1);
+        key_queue_clear(&keys);
+        int key = -1;
+        while(key < 0 && input_read_keys(&keys, -1) >= 0) // wait for one key, -1 if input ends first
         {
-            printf("Sorry, your input was invalid, try again...\n");
-            goto GET_INPUT; // explicit jump to get user to enter input again
+            key = key_queue_pop(&keys);
         }
-
-        // if the user reaches 2048 print a special message
-        if(game->highest_tile == 2048)
+        if(tolower(key) == 'u' && history_undo(history, game))
         {
-            printf("You've won!\n");
-            printf("You've reached the tile 2048!\n");
-            printf("Press Q to quit, any other character to continue: \n");
-            int quit = getchar();
-            if(tolower(quit) == 'q')
-            {
-                break;
-            }
+            key_queue_clear(&keys);
+            render_message(&renderer, "");
+            goto GAME_LOOP;
         }
     }
-    // print final stats
-    printf("The game is done!\n");
-    printf("Your stats this round...\n");
-    game_print(game, NO_LOG);
+    // show final stats
+    render_message(&renderer, "The game is done! Your stats this round are shown above.");
+    render_frame(&renderer, game, 1);
+    history_free(history);
     game_free(game);
-}
\ No newline at end of file
+    restore_terminal();
+}
@@ -0,0 +1,243 @@
+#include "2048.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+    N-tuple network: values of 4x4 boards learned by temporal difference self-play
+
+    A tuple is a fixed set of cells, and the exponents in those cells index a table of
+    weights. The value of a board is the sum of the weights of every tuple, looked up on all
+    8 symmetries of the board (bitboard_transform()), so a rotated or mirrored position gets
+    the same value and every game trains 8 times as many patterns. With 4 tuples of 4 cells
+    that is 32 lookups into 4 tables of 65536 floats (1 MB).
+
+    Weights files are the header followed by the tables exactly as they sit in memory, so
+    the interactive program and the simulations map a trained file and read it in place.
+    ntuple_update() writes weights with plain stores and no locks: the trainer's threads share
+    one network and an update racing with another one may be lost, which the learning
+    tolerates (Hogwild!).
+*/
+
+// cells of each tuple: the outer row, the next row, the corner square and a middle square
+static const uint8_t tuple_cells[NTUPLE_COUNT][NTUPLE_LENGTH] =
+{
+    {0, 1, 2, 3},
+    {4, 5, 6, 7},
+    {0, 1, 4, 5},
+    {5, 6, 9, 10},
+};
+
+// network policy_ntuple() plays with, set by ntuple_use_weights()
+static ntuple_net_t *policy_net = NULL;
+
+// returns the amount of bytes of a network, header included
+static size_t net_size()
+{
+    return sizeof(ntuple_header_t) + (size_t)NTUPLE_COUNT * NTUPLE_ENTRIES * sizeof(float);
+}
+
+// allocates a network with every weight 0, the header describes the tuples of this build
+ntuple_net_t *ntuple_create()
+{
+    ntuple_header_t *header = calloc(1, net_size());
+    if(header == NULL)
+    {
+        return NULL;
+    }
+    header->magic = NTUPLE_MAGIC;
+    header->version = NTUPLE_VERSION;
+    header->tuple_count = NTUPLE_COUNT;
+    header->tuple_length = NTUPLE_LENGTH;
+    memcpy(header->cells, tuple_cells, sizeof(tuple_cells));
+    ntuple_net_t *net = malloc(sizeof(ntuple_net_t));
+    net->header = header;
+    net->weights = (float *)(header + 1);
+    net->size = net_size();
+    net->mapped = 0;
+    return net;
+}
+
+/*
+    Maps a weights file, the file has to hold the tuples of this build
+    A writable mapping is private, the file only changes when the network is saved over it
+
+    Returns NULL if the file cannot be mapped or is malformed
+*/
+ntuple_net_t *ntuple_open(char *path, int writable)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size != net_size())
+    {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after the descriptor is closed
+    if(data == MAP_FAILED)
+    {
+        return NULL;
+    }
+    ntuple_header_t *header = data;
+    if(header->magic != NTUPLE_MAGIC || header->version != NTUPLE_VERSION || header->tuple_count != NTUPLE_COUNT ||
+        header->tuple_length != NTUPLE_LENGTH || memcmp(header->cells, tuple_cells, sizeof(tuple_cells)) != 0)
+    {
+        munmap(data, info.st_size);
+        return NULL;
+    }
+    ntuple_net_t *net = malloc(sizeof(ntuple_net_t));
+    net->header = header;
+    net->weights = (float *)(header + 1);
+    net->size = info.st_size;
+    net->mapped = 1;
+    return net;
+}
+
+/*
+    Writes the network to "<path>.tmp" and renames it over path, so a reader never sees half a file
+    Other threads may keep training meanwhile, the file then holds weights from the middle of their updates
+
+    Returns 1 on success, 0 if the file could not be written
+*/
+int ntuple_save(ntuple_net_t *net, char *path)
+{
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *file = fopen(temporary, "wb");
+    if(file == NULL)
+    {
+        return 0;
+    }
+    int ok = fwrite(net->header, net->size, 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(temporary, path) != 0)
+    {
+        remove(temporary);
+        return 0;
+    }
+    return 1;
+}
+
+// frees or unmaps a network
+void ntuple_free(ntuple_net_t *net)
+{
+    if(net->mapped)
+    {
+        munmap(net->header, net->size);
+    }
+    else
+    {
+        free(net->header);
+    }
+    free(net);
+}
+
+// finds the weight of every tuple in all 8 symmetries of the board, as offsets into net->weights
+static void tuple_offsets(board_t board, uint32_t offsets[NTUPLE_LOOKUPS])
+{
+    int lookup = 0;
+    for(int transform = 0; transform < 8; transform++)
+    {
+        board_t transformed = bitboard_transform(board, transform);
+        for(int tuple = 0; tuple < NTUPLE_COUNT; tuple++)
+        {
+            uint32_t index = 0;
+            for(int cell = 0; cell < NTUPLE_LENGTH; cell++)
+            {
+                index |= ((transformed >> (tuple_cells[tuple][cell] * CELL_BITS)) & CELL_MASK) << (cell * CELL_BITS);
+            }
+            offsets[lookup++] = tuple * NTUPLE_ENTRIES + index;
+        }
+    }
+}
+
+// returns the value of a board: the sum of the weights of every tuple in all 8 of its symmetries
+float ntuple_value(ntuple_net_t *net, board_t board)
+{
+    uint32_t offsets[NTUPLE_LOOKUPS];
+    tuple_offsets(board, offsets);
+    float value = 0.0f;
+    for(int lookup = 0; lookup < NTUPLE_LOOKUPS; lookup++)
+    {
+        value += net->weights[offsets[lookup]];
+    }
+    return value;
+}
+
+// adds delta to the value of a board, every weight it is made of gets an equal share
+void ntuple_update(ntuple_net_t *net, board_t board, float delta)
+{
+    uint32_t offsets[NTUPLE_LOOKUPS];
+    tuple_offsets(board, offsets);
+    float share = delta / NTUPLE_LOOKUPS;
+    for(int lookup = 0; lookup < NTUPLE_LOOKUPS; lookup++)
+    {
+        net->weights[offsets[lookup]] += share;
+    }
+}
+
+/*
+    Picks the direction with the most points plus value of the board right after the move (before its random tile)
+    Sets *afterP to that board, *scoreP to its points plus value and *valueP to its value alone
+
+    Returns -1 if no direction changes the board
+*/
+int ntuple_best_move(ntuple_net_t *net, board_t board, board_t *afterP, float *scoreP, float *valueP)
+{
+    int best_dir = -1;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        int points = 0;
+        uint8_t changed;
+        board_t after = bitboard_move_board(board, dir, &points, &changed);
+        if(!changed)
+        {
+            continue;
+        }
+        float value = ntuple_value(net, after);
+        float score = points + value;
+        if(best_dir < 0 || score > *scoreP)
+        {
+            best_dir = dir;
+            *afterP = after;
+            *scoreP = score;
+            *valueP = value;
+        }
+    }
+    return best_dir;
+}
+
+// maps the weights file policy_ntuple() plays with read-only, returns 0 if it cannot be used
+int ntuple_use_weights(char *path)
+{
+    ntuple_net_t *net = ntuple_open(path, 0);
+    if(net == NULL)
+    {
+        return 0;
+    }
+    if(policy_net != NULL)
+    {
+        ntuple_free(policy_net);
+    }
+    policy_net = net;
+    return 1;
+}
+
+// move policy wrapper so the network can be used by the simulation driver and the interactive program
+int policy_ntuple(game_t *game)
+{
+    if(policy_net == NULL || game->size != BITBOARD_LENGTH) // tuples are cells of packed 4x4 bitboards
+    {
+        return policy_corner_greedy(game);
+    }
+    board_t after;
+    float score;
+    float value;
+    int dir = ntuple_best_move(policy_net, game->bitboard, &after, &score, &value);
+    return dir >= 0 ? dir : NORTH;
+}
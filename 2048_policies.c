@@ -0,0 +1,81 @@
+#include "2048.h"
+
+/*
+    Move policies used to play games without a human
+
+    Each policy looks at the game and returns a direction to pass to move_all().
+    Policies only return directions that change the board as long as the game is running.
+*/
+
+// order in which corner_greedy breaks ties, keeps big tiles in the bottom-left corner
+int corner_priority[4] = {SOUTH, WEST, EAST, NORTH};
+
+// picks a random direction among the ones that change the board
+int policy_random(game_t *game)
+{
+    int legal[4];
+    int count = 0;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        if(game_can_move(game, dir))
+        {
+            legal[count++] = dir;
+        }
+    }
+    if(count == 0) // no direction changes the board, game is over
+    {
+        return NORTH;
+    }
+    return legal[rng_range(&game->policy_rng, count)];
+}
+
+/*
+    Picks the direction that gains the most points this move
+    Ties are broken by corner_priority so tiles pile up in the bottom-left corner
+*/
+int policy_corner_greedy(game_t *game)
+{
+    int best_dir = NORTH;
+    int best_points = -1;
+    for(int index = 0; index < 4; index++)
+    {
+        int dir = corner_priority[index];
+        int points = 0;
+        if(!game_preview_move(game, dir, &points)) // move does nothing
+        {
+            continue;
+        }
+        if(points > best_points)
+        {
+            best_points = points;
+            best_dir = dir;
+        }
+    }
+    return best_dir;
+}
+
+// returns the policy with the given name, NULL if there is none
+move_policy_t policy_by_name(char *name)
+{
+    if(strcmp(name, "random") == 0)
+    {
+        return policy_random;
+    }
+    if(strcmp(name, "corner") == 0)
+    {
+        return policy_corner_greedy;
+    }
+    if(strcmp(name, "expectimax") == 0)
+    {
+        return policy_expectimax;
+    }
+    if(strcmp(name, "rollout") == 0)
+    {
+        return policy_rollout;
+    }
+    if(strcmp(name, "ntuple") == 0)
+    {
+        return policy_ntuple;
+    }
+    return NULL;
+}
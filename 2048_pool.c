@@ -0,0 +1,128 @@
+#include "2048.h"
+#include <pthread.h>
+
+/*
+    Pool of sleeping threads that help the calling thread with one batch of work at a time,
+    shared by the expectimax search (2048_ai.c) and the rollout player (2048_rollout.c)
+
+    Pool threads are started once and never exit. Every thread knows its worker index (the
+    calling thread is worker 0, pool thread i is worker i + 1) and a batch only runs on the
+    workers below the amount of threads it was started with, so a pool grown to 8 threads and
+    then run with 2 wakes its 7 threads but only worker 1 takes part; the others go back to
+    sleep without being counted.
+*/
+
+struct thread_pool
+{
+    pthread_t threads[MAX_POOL_THREADS - 1];
+    int count; // amount of pool threads, not counting the thread calling thread_pool_run()
+    pthread_mutex_t lock;
+    pthread_cond_t start; // signalled when a new batch is ready
+    pthread_cond_t done; // signalled when the last pool thread of a batch finishes
+    int generation; // incremented for every batch so sleeping threads know there is new work
+    int workers; // amount of workers the current batch runs on, the calling thread included
+    int active; // amount of pool threads still working on the current batch
+    pool_work_t work; // work of the current batch and its argument
+    void *arg;
+};
+
+// what each pool thread is started with
+typedef struct
+{
+    thread_pool_t *pool;
+    int worker;
+}
+pool_thread_arg_t;
+
+// body of each pool thread: sleep until a batch starts, help finish it if it runs on this worker, report back
+static void *pool_thread(void *arg)
+{
+    pool_thread_arg_t *start = arg;
+    thread_pool_t *pool = start->pool;
+    int worker = start->worker;
+    free(start);
+    int seen_generation = 0;
+    while(1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while(pool->generation == seen_generation)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        seen_generation = pool->generation;
+        int joins = worker < pool->workers;
+        pool_work_t work = pool->work;
+        void *work_arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+        if(!joins) // a batch started with fewer threads than the pool has
+        {
+            continue;
+        }
+
+        work(work_arg, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->active == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+// allocates a pool without threads, it lives until the program exits
+thread_pool_t *thread_pool_init()
+{
+    thread_pool_t *pool = calloc(1, sizeof(thread_pool_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    return pool;
+}
+
+/*
+    Starts pool threads until batches can run on the given amount of threads (the calling thread is one of them)
+    The pool never shrinks, threads above the amount a batch runs on sleep through it
+*/
+void thread_pool_grow(thread_pool_t *pool, int threads)
+{
+    if(threads > MAX_POOL_THREADS)
+    {
+        threads = MAX_POOL_THREADS;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while(pool->count < threads - 1)
+    {
+        pool_thread_arg_t *arg = malloc(sizeof(pool_thread_arg_t));
+        *arg = (pool_thread_arg_t){pool, pool->count + 1};
+        pthread_create(&pool->threads[pool->count], NULL, pool_thread, arg);
+        pool->count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+    Runs work(arg, worker) on the calling thread (worker 0) and on pool threads 1 to threads - 1,
+    returns once every one of them has finished; the pool is grown first if it is too small
+    Only one thread may run batches on a pool at a time
+*/
+void thread_pool_run(thread_pool_t *pool, int threads, pool_work_t work, void *arg)
+{
+    thread_pool_grow(pool, threads);
+    pthread_mutex_lock(&pool->lock);
+    pool->workers = threads < pool->count + 1 ? threads : pool->count + 1;
+    pool->active = pool->workers - 1;
+    pool->work = work;
+    pool->arg = arg;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    work(arg, 0);
+    pthread_mutex_lock(&pool->lock);
+    while(pool->active > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
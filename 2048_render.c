@@ -0,0 +1,120 @@
+#include "2048.h"
+#include <stdarg.h>
+
+/*
+    Terminal renderer that redraws the game in place
+
+    The first frame clears the screen and draws the header, the board, the points and the
+    status line at fixed positions. Later frames only move the cursor (ANSI CUP escapes) to
+    the cells and lines that changed since the last frame and redraw those. Every frame is
+    built in one buffer and sent with a single write(), so a frame costs one syscall.
+
+    Frames can be capped to a frame rate: a frame asked for too soon after the last one is
+    skipped unless it is forced, so autoplay can run at full speed while drawing e.g. 30 fps.
+*/
+
+// appends formatted text to the frame, text that does not fit is cut off
+static void render_append(renderer_t *renderer, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int space = RENDER_BUFFER_SIZE - renderer->length;
+    int written = vsnprintf(renderer->buffer + renderer->length, space, format, args);
+    va_end(args);
+    renderer->length += written < space ? written : space - 1;
+}
+
+// sets up a renderer that draws header above the board and renders at most fps frames a second (0 for no cap)
+void render_init(renderer_t *renderer, char *header, int fps)
+{
+    memset(renderer, 0, sizeof(renderer_t));
+    renderer->header = header;
+    for(char *c = header; *c != '\0'; c++)
+    {
+        renderer->header_lines += *c == '\n';
+    }
+    renderer->frame_interval = fps > 0 ? 1000000000LL / fps : 0;
+}
+
+// forces the next frame to clear the screen and repaint everything, needed after printing anything else
+void render_invalidate(renderer_t *renderer)
+{
+    renderer->drawn = 0;
+}
+
+// sets the status line shown under the board on the next frame
+void render_message(renderer_t *renderer, char *message)
+{
+    snprintf(renderer->message, RENDER_MESSAGE_SIZE, "%s", message);
+}
+
+/*
+    Draws the game, repainting only the cells and lines that changed since the last frame
+    Unless force is set, the frame is skipped if the last one was less than a frame interval ago
+
+    Returns 1 if the frame was drawn, 0 if it was skipped
+*/
+int render_frame(renderer_t *renderer, game_t *game, int force)
+{
+    long long now = now_ns();
+    if(!force && renderer->drawn && now - renderer->last_frame < renderer->frame_interval)
+    {
+        renderer->skipped++;
+        return 0;
+    }
+    int full = !renderer->drawn;
+    int board_line = renderer->header_lines + 2; // 1-based screen line of the first board row
+    renderer->length = 0;
+    if(full)
+    {
+        render_append(renderer, "\x1b[2J\x1b[H%s", renderer->header);
+    }
+    for(int row = 0; row < game->size; row++)
+    {
+        for(int col = 0; col < game->size; col++)
+        {
+            int value = game->board[START + row][START + col];
+            int *shown = &renderer->cells[row * MAX_BOARD_SIZE + col];
+            if(full || *shown != value)
+            {
+                render_append(renderer, "\x1b[%d;%dH%*d", board_line + row, col * RENDER_CELL_WIDTH + 1,
+                    RENDER_CELL_WIDTH, value);
+                *shown = value;
+            }
+        }
+    }
+    int points_line = board_line + game->size + 1;
+    if(full || renderer->points != game->points)
+    {
+        render_append(renderer, "\x1b[%d;1Hpoints: %d\x1b[K", points_line, game->points);
+        renderer->points = game->points;
+    }
+    if(full || renderer->highest_tile != game->highest_tile)
+    {
+        render_append(renderer, "\x1b[%d;1Hhighest_tile: %d\x1b[K", points_line + 1, game->highest_tile);
+        renderer->highest_tile = game->highest_tile;
+    }
+    if(full || strcmp(renderer->drawn_message, renderer->message) != 0)
+    {
+        render_append(renderer, "\x1b[%d;1H%s\x1b[K", points_line + 2, renderer->message);
+        strcpy(renderer->drawn_message, renderer->message);
+    }
+    render_append(renderer, "\x1b[%d;1H", points_line + 3); // park the cursor under everything drawn
+
+    fflush(stdout); // anything printed through stdio has to reach the terminal before the frame
+    int offset = 0;
+    while(offset < renderer->length)
+    {
+        ssize_t written = write(STDOUT_FILENO, renderer->buffer + offset, renderer->length - offset);
+        if(written <= 0)
+        {
+            break;
+        }
+        offset += written;
+    }
+    renderer->bytes += offset;
+    renderer->frames++;
+    renderer->drawn = 1;
+    renderer->last_frame = now;
+    return 1;
+}
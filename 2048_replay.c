@@ -0,0 +1,246 @@
+#include "2048.h"
+
+/*
+    Compact binary game logs and a fast-forward replay engine
+
+    A log holds the seed of the game and every move as 2 bits, and optionally every
+    spawned tile as one byte (cell index in the low 4 bits, exponent - 1 in the high bits).
+    Because every random tile comes from the game's own seeded rng, the seed and the moves
+    are enough to rebuild the whole game; recorded spawns are only used to verify that.
+
+    Replays follow the same protocol as every headless game: two random tiles to start,
+    then after each move a random tile is placed only if the move changed the board.
+    Replays run on the bitboard alone and only copy the result into a game at the end.
+
+    File layout (little-endian): game_log_header_t, then move_count moves packed 4 per byte,
+    then spawn_count spawn bytes if LOG_HAS_SPAWNS is set. Logs can be appended one after another.
+*/
+
+// grows the move and spawn arrays of the log when they are full
+static void game_log_grow(game_log_t *log)
+{
+    log->capacity = log->capacity == 0 ? 256 : log->capacity * 2;
+    log->moves = realloc(log->moves, (log->capacity + 3) / 4);
+    if(log->header.flags & LOG_HAS_SPAWNS)
+    {
+        log->spawns = realloc(log->spawns, log->capacity + 2);
+    }
+}
+
+// allocates an empty log for a game played with the given seed, spawns are stored if record_spawns is non-zero
+game_log_t *game_log_init(uint64_t seed, int record_spawns)
+{
+    game_log_t *log = calloc(1, sizeof(game_log_t));
+    log->header.magic = LOG_MAGIC;
+    log->header.version = LOG_VERSION;
+    log->header.flags = record_spawns ? LOG_HAS_SPAWNS : 0;
+    log->header.seed = seed;
+    game_log_grow(log);
+    return log;
+}
+
+// frees a log and its move and spawn arrays
+void game_log_free(game_log_t *log)
+{
+    free(log->moves);
+    free(log->spawns);
+    free(log);
+}
+
+// appends a move direction (2 bits) to the log
+void game_log_add_move(game_log_t *log, int dir)
+{
+    uint32_t index = log->header.move_count;
+    if(index >= log->capacity)
+    {
+        game_log_grow(log);
+    }
+    int shift = (index % 4) * 2;
+    log->moves[index / 4] = (log->moves[index / 4] & ~(3 << shift)) | (dir << shift);
+    log->header.move_count++;
+}
+
+// returns the move at the given turn of the log
+int game_log_move(game_log_t *log, uint32_t turn)
+{
+    return (log->moves[turn / 4] >> ((turn % 4) * 2)) & 3;
+}
+
+// appends the tile that appeared between before and after, does nothing if spawns are not recorded
+void game_log_add_spawn(game_log_t *log, board_t before, board_t after)
+{
+    if(!(log->header.flags & LOG_HAS_SPAWNS))
+    {
+        return;
+    }
+    if(log->header.spawn_count >= log->capacity + 2)
+    {
+        game_log_grow(log);
+    }
+    board_t spawned = before ^ after;
+    int cell = __builtin_ctzll(spawned) / CELL_BITS;
+    int exponent = (after >> (cell * CELL_BITS)) & CELL_MASK;
+    log->spawns[log->header.spawn_count++] = cell | ((exponent - 1) << 4);
+}
+
+// records the final points and highest tile of the game so replays can be verified against them
+void game_log_finish(game_log_t *log, game_t *game)
+{
+    log->header.final_points = game->points;
+    log->header.highest_tile = game->highest_tile;
+}
+
+// writes the log at the current position of the file, returns 1 on success
+int game_log_write(game_log_t *log, FILE *file)
+{
+    size_t move_bytes = (log->header.move_count + 3) / 4;
+    if(fwrite(&log->header, sizeof(game_log_header_t), 1, file) != 1)
+    {
+        return 0;
+    }
+    if(move_bytes > 0 && fwrite(log->moves, 1, move_bytes, file) != move_bytes)
+    {
+        return 0;
+    }
+    if((log->header.flags & LOG_HAS_SPAWNS) && log->header.spawn_count > 0 &&
+        fwrite(log->spawns, 1, log->header.spawn_count, file) != log->header.spawn_count)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+// reads the next log of the file, returns NULL at the end of the file or if the log is malformed
+game_log_t *game_log_read(FILE *file)
+{
+    game_log_header_t header;
+    if(fread(&header, sizeof(game_log_header_t), 1, file) != 1 || header.magic != LOG_MAGIC || header.version != LOG_VERSION)
+    {
+        return NULL;
+    }
+    game_log_t *log = calloc(1, sizeof(game_log_t));
+    log->header = header;
+    log->capacity = header.move_count;
+    size_t move_bytes = (header.move_count + 3) / 4;
+    log->moves = malloc(move_bytes + 1);
+    if(fread(log->moves, 1, move_bytes, file) != move_bytes)
+    {
+        game_log_free(log);
+        return NULL;
+    }
+    if(header.flags & LOG_HAS_SPAWNS)
+    {
+        log->spawns = malloc(header.spawn_count + 1);
+        if(fread(log->spawns, 1, header.spawn_count, file) != header.spawn_count)
+        {
+            game_log_free(log);
+            return NULL;
+        }
+    }
+    return log;
+}
+
+/*
+    Plays one game to completion with the given policy while recording it into the log
+    The game is reset and seeded with the log's seed first, returns the amount of moves made
+*/
+long play_logged_game(game_t *game, move_policy_t policy, game_log_t *log)
+{
+    game_reset(game);
+    game_seed(game, log->header.seed);
+    for(int tile = 0; tile < 2; tile++)
+    {
+        board_t before = game->bitboard;
+        place_random_tile(game);
+        game_log_add_spawn(log, before, game->bitboard);
+    }
+    long moves = 0;
+    while(game_running(game))
+    {
+        game->game_status = RUNNING;
+        int dir = policy(game);
+        int moved = move_all(game, dir);
+        game_log_add_move(log, dir);
+        moves++;
+        if(moved)
+        {
+            board_t before_spawn = game->bitboard;
+            place_random_tile(game);
+            game_log_add_spawn(log, before_spawn, game->bitboard);
+        }
+    }
+    game_log_finish(log, game);
+    return moves;
+}
+
+/*
+    Places the next random tile of a replay and checks it against the recorded spawn if there is one
+    Returns 0 if the spawn does not match the log
+*/
+static int replay_spawn(game_log_t *log, board_t *board, rng_t *rng, uint32_t *spawn_index)
+{
+    board_t before = *board;
+    *board = bitboard_place_random_tile(before, rng);
+    if(!(log->header.flags & LOG_HAS_SPAWNS))
+    {
+        return 1;
+    }
+    if(*spawn_index >= log->header.spawn_count)
+    {
+        return 0;
+    }
+    uint8_t spawn = log->spawns[(*spawn_index)++];
+    int cell = spawn & 0xF;
+    int exponent = (spawn >> 4) + 1;
+    return (before ^ *board) == ((board_t)exponent << (cell * CELL_BITS));
+}
+
+/*
+    Fast-forwards the log to the given turn (amount of moves applied) without printing anything
+    The game is reset and ends up in the position after that turn, with its rng ready to continue
+
+    Returns the amount of turns replayed, or -1 if a recorded spawn does not match the replay
+*/
+long replay_to_turn(game_log_t *log, game_t *game, uint32_t turn)
+{
+    if(turn > log->header.move_count)
+    {
+        turn = log->header.move_count;
+    }
+    rng_t rng;
+    rng_seed(&rng, log->header.seed);
+    board_t board = 0;
+    int points = 0;
+    uint32_t spawn_index = 0;
+    int ok = replay_spawn(log, &board, &rng, &spawn_index) && replay_spawn(log, &board, &rng, &spawn_index);
+    for(uint32_t index = 0; ok && index < turn; index++)
+    {
+        board_t moved = bitboard_move(board, game_log_move(log, index), &points);
+        if(moved != board)
+        {
+            board = moved;
+            ok = replay_spawn(log, &board, &rng, &spawn_index);
+        }
+    }
+    // copy the replayed position into the game once, instead of syncing it every move
+    game_reset(game);
+    game_seed(game, log->header.seed);
+    game->rng = rng;
+    game_set_bitboard(game, board);
+    game->points = points;
+    game->game_status = game_running(game) ? RUNNING : DONE;
+    return ok ? (long)turn : -1;
+}
+
+/*
+    Replays the whole log and checks it against the recorded final points and highest tile
+    Returns 1 if the replay matches the log, otherwise 0
+*/
+int replay_verify(game_log_t *log, game_t *game)
+{
+    if(replay_to_turn(log, game, log->header.move_count) < 0)
+    {
+        return 0;
+    }
+    return game->points == (int)log->header.final_points && game->highest_tile == (int)log->header.highest_tile;
+}
@@ -0,0 +1,125 @@
+#include "2048.h"
+
+// plays games with a policy and appends the log of each one to the file
+int record_logs(char *path, long games, uint64_t seed, move_policy_t policy, int record_spawns)
+{
+    FILE *file = fopen(path, "wb");
+    if(file == NULL)
+    {
+        printf("cannot open %s\n", path);
+        return 1;
+    }
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
+    for(long index = 0; index < games; index++)
+    {
+        game_log_t *log = game_log_init(rng_mix_seed(seed, index), record_spawns);
+        play_logged_game(game, policy, log);
+        game_log_write(log, file);
+        game_log_free(log);
+    }
+    game_free(game);
+    fclose(file);
+    printf("recorded %ld games to %s\n", games, path);
+    return 0;
+}
+
+// replays every log of the file and checks each against its recorded points and highest tile
+int verify_logs(char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        printf("cannot open %s\n", path);
+        return 1;
+    }
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
+    long games = 0, failed = 0, moves = 0;
+    long long start = now_ns();
+    game_log_t *log;
+    while((log = game_log_read(file)) != NULL)
+    {
+        if(!replay_verify(log, game))
+        {
+            printf("game %ld does not match its log (points %d vs %u)\n", games, game->points, log->header.final_points);
+            failed++;
+        }
+        moves += log->header.move_count;
+        games++;
+        game_log_free(log);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    game_free(game);
+    fclose(file);
+    printf("verified %ld games (%ld failed), %ld moves in %.3f seconds (%.1f games/sec)\n",
+        games, failed, moves, seconds, games / seconds);
+    return failed != 0;
+}
+
+// jumps to a turn of one logged game and prints the board at that point
+int show_log(char *path, long game_index, uint32_t turn)
+{
+    FILE *file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        printf("cannot open %s\n", path);
+        return 1;
+    }
+    game_log_t *log = NULL;
+    for(long index = 0; index <= game_index; index++)
+    {
+        if(log != NULL)
+        {
+            game_log_free(log);
+        }
+        log = game_log_read(file);
+        if(log == NULL)
+        {
+            printf("%s has no game %ld\n", path, game_index);
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
+    long replayed = replay_to_turn(log, game, turn);
+    printf("game %ld, turn %ld of %u, seed %llu\n", game_index, replayed, log->header.move_count,
+        (unsigned long long)log->header.seed);
+    game_print(game, NO_LOG);
+    game_free(game);
+    game_log_free(log);
+    return replayed < 0;
+}
+
+/*
+    This main method records, verifies and
+    replays binary game logs.
+
+    usage:
+    ./replay record <file> <games> <seed> [policy] [spawns]
+    ./replay verify <file>
+    ./replay show <file> <game> <turn>
+*/
+int main(int argc, char **argv)
+{
+    if(argc >= 5 && strcmp(argv[1], "record") == 0)
+    {
+        move_policy_t policy = policy_by_name(argc > 5 ? argv[5] : "random");
+        if(policy != NULL)
+        {
+            return record_logs(argv[2], atol(argv[3]), strtoull(argv[4], NULL, 10), policy, argc > 6 && atoi(argv[6]));
+        }
+    }
+    else if(argc >= 3 && strcmp(argv[1], "verify") == 0)
+    {
+        return verify_logs(argv[2]);
+    }
+    else if(argc >= 5 && strcmp(argv[1], "show") == 0)
+    {
+        return show_log(argv[2], atol(argv[3]), (uint32_t)atol(argv[4]));
+    }
+    printf("usage:\n");
+    printf("  %s record <file> <games> <seed> [random|corner|expectimax] [spawns]\n", argv[0]);
+    printf("  %s verify <file>\n", argv[0]);
+    printf("  %s show <file> <game> <turn>\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,60 @@
+#include "2048.h"
+
+/*
+    xoshiro256** random number generator
+
+    Each game owns its own rng_t so games can run on several threads at once,
+    and seeding a game with the same value always reproduces the same game.
+*/
+
+// rotates x left by k bits
+static uint64_t rotate_left(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64 step, spreads a single seed over the 256 bits of state
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// seeds the generator, any seed (including 0) gives a valid state
+void rng_seed(rng_t *rng, uint64_t seed)
+{
+    for(int index = 0; index < 4; index++)
+    {
+        rng->s[index] = splitmix64(&seed);
+    }
+}
+
+// returns the next 64 random bits
+uint64_t rng_next(rng_t *rng)
+{
+    uint64_t *s = rng->s;
+    uint64_t result = rotate_left(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotate_left(s[3], 45);
+    return result;
+}
+
+// returns a random number in [0, bound) using a multiply instead of a modulo
+int rng_range(rng_t *rng, int bound)
+{
+    return (int)(((rng_next(rng) >> 32) * (uint64_t)bound) >> 32);
+}
+
+// mixes a base seed with an index (e.g. game number) so every index gets an unrelated stream
+uint64_t rng_mix_seed(uint64_t seed, uint64_t index)
+{
+    uint64_t x = seed ^ (index * 0xD1B54A32D192ED03ULL);
+    return splitmix64(&x);
+}
@@ -0,0 +1,293 @@
+#include "2048.h"
+#include <stdatomic.h>
+#include <limits.h>
+#include <math.h>
+
+/*
+    Monte Carlo rollout player
+
+    Each legal direction is moved once with move_all()'s kernel and then played to the end
+    of the game many times with random moves (a playout). The direction with the best mean
+    final points wins. Playouts only touch the packed bitboard, so one costs a few
+    microseconds and the strength of the player is just the amount of playouts per move.
+
+    Playouts are handed out in chunks of ROLLOUT_CHUNK, round-robin over the legal
+    directions, so every direction has the same amount of playouts at any time. A move stops
+    when the per-direction budget is spent, when its deadline passes, or as soon as the best
+    direction's mean is ROLLOUT_Z standard errors clear of every other direction.
+
+    With more than one thread the chunks are taken by the workers of a thread pool
+    ("2048_pool.c"), each drawing its moves and tiles from its own generator seeded from the
+    game's policy generator and its worker index, and the per-direction sums are merged with
+    atomic adds after every chunk, so nothing is locked while playing.
+*/
+
+#define ROLLOUT_CHUNK           16   // playouts a thread runs before merging its sums and checking for a stop
+#define ROLLOUT_MIN_PLAYOUTS    64   // playouts each direction needs before a move can stop early
+#define ROLLOUT_Z               3.0  // standard errors the best direction must be ahead by to stop early
+
+// running sums of the playouts of one root direction
+typedef struct
+{
+    board_t board; // board after the root move, before its spawn
+    int points; // points the root move gained
+    atomic_long count;
+    atomic_long sum; // sum of the points of every playout, root move included
+    atomic_long sum_squares;
+}
+rollout_arm_t;
+
+// state of the rollouts of one move, shared by every thread working on it
+typedef struct
+{
+    rollout_arm_t arms[4];
+    int dirs[4]; // legal directions, in the order chunks are dealt to them
+    int dir_count;
+    long chunk_limit; // amount of chunks of the whole move, LONG_MAX if only the deadline limits it
+    atomic_long next_chunk; // index of the next chunk to be taken
+    atomic_int stop; // set once the move has a result, chunks not yet started are skipped
+    double deadline; // time (seconds) after which no more chunks are started, 0 for none
+    uint64_t seed; // seeds the generator of each pool thread for this move
+}
+rollout_t;
+
+// pool of threads that share the playouts of a move
+static thread_pool_t *pool = NULL;
+
+// serial rollouts keep their state per thread so simulations can use the rollout player on all cores
+static __thread rollout_t local_rollout;
+
+// the pool works on this one
+static rollout_t shared_rollout;
+
+// playouts per direction of each move (0 for no limit) and time budget of each move in milliseconds (0 for no limit)
+static int playout_budget = ROLLOUT_DEFAULT_PLAYOUTS;
+static int rollout_budget_ms = 0;
+
+// amount of threads rollout_suggest_move() plays with
+static int rollout_threads = 1;
+
+// totals over every move, for rollouts/sec
+static atomic_long total_playouts;
+static atomic_long total_nanoseconds;
+
+/*
+    Sets the budget of each move, in playouts per direction and in milliseconds
+    Either one can be 0 for no limit, with both 0 the default amount of playouts is used
+*/
+void rollout_set_budget(int playouts, int milliseconds)
+{
+    playout_budget = playouts > 0 || milliseconds > 0 ? playouts : ROLLOUT_DEFAULT_PLAYOUTS;
+    rollout_budget_ms = milliseconds > 0 ? milliseconds : 0;
+}
+
+// returns the amount of playouts run and the seconds spent choosing moves since the program started
+void rollout_stats(long *playoutsP, double *secondsP)
+{
+    *playoutsP = atomic_load(&total_playouts);
+    *secondsP = atomic_load(&total_nanoseconds) / 1e9;
+}
+
+/*
+    Plays a board to the end of the game with random moves, returns the points gained
+    A direction that does not change the board is crossed off and another one is drawn,
+    so no separate legality check is needed
+*/
+static int playout(board_t board, rng_t *rng)
+{
+    int points = 0;
+    while(1)
+    {
+        board = bitboard_place_random_tile(board, rng);
+        int untried = 0xF;
+        uint8_t changed = 0;
+        while(untried && !changed)
+        {
+            int skip = rng_range(rng, __builtin_popcount(untried));
+            int dirs = untried;
+            for(int skipped = 0; skipped < skip; skipped++)
+            {
+                dirs &= dirs - 1;
+            }
+            int dir = __builtin_ctz(dirs);
+            untried &= ~(1 << dir);
+            board = bitboard_move_board(board, dir, &points, &changed);
+        }
+        if(!changed) // no direction changes the board, game is over
+        {
+            return points;
+        }
+    }
+}
+
+// returns 1 once the best direction is ROLLOUT_Z standard errors ahead of all the others
+static int clearly_ahead(rollout_t *rollout)
+{
+    double means[4];
+    double errors[4];
+    int best = 0;
+    for(int index = 0; index < rollout->dir_count; index++)
+    {
+        rollout_arm_t *arm = &rollout->arms[rollout->dirs[index]];
+        long count = atomic_load_explicit(&arm->count, memory_order_relaxed);
+        if(count < ROLLOUT_MIN_PLAYOUTS)
+        {
+            return 0;
+        }
+        double sum = atomic_load_explicit(&arm->sum, memory_order_relaxed);
+        double sum_squares = atomic_load_explicit(&arm->sum_squares, memory_order_relaxed);
+        means[index] = sum / count;
+        double variance = sum_squares / count - means[index] * means[index];
+        errors[index] = sqrt(variance > 0.0 ? variance / count : 0.0);
+        if(means[index] > means[best])
+        {
+            best = index;
+        }
+    }
+    for(int index = 0; index < rollout->dir_count; index++)
+    {
+        if(index != best && means[best] - ROLLOUT_Z * errors[best] <= means[index] + ROLLOUT_Z * errors[index])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// takes chunks of the move until none are left or the move stops, playing with the given generator
+static void rollout_run_chunks(rollout_t *rollout, rng_t *rng)
+{
+    long chunk;
+    while(!atomic_load_explicit(&rollout->stop, memory_order_relaxed) &&
+        (chunk = atomic_fetch_add(&rollout->next_chunk, 1)) < rollout->chunk_limit)
+    {
+        rollout_arm_t *arm = &rollout->arms[rollout->dirs[chunk % rollout->dir_count]];
+        long sum = 0;
+        long sum_squares = 0;
+        for(int index = 0; index < ROLLOUT_CHUNK; index++)
+        {
+            long points = arm->points + playout(arm->board, rng);
+            sum += points;
+            sum_squares += points * points;
+        }
+        atomic_fetch_add_explicit(&arm->sum, sum, memory_order_relaxed);
+        atomic_fetch_add_explicit(&arm->sum_squares, sum_squares, memory_order_relaxed);
+        atomic_fetch_add_explicit(&arm->count, ROLLOUT_CHUNK, memory_order_relaxed);
+        if((rollout->deadline > 0.0 && now_ns() / 1e9 > rollout->deadline) || clearly_ahead(rollout))
+        {
+            atomic_store(&rollout->stop, 1);
+        }
+    }
+}
+
+// work of every thread of the pool: plays chunks with its own generator, seeded from the move's seed and its worker index
+static void run_pool_chunks(void *arg, int worker)
+{
+    rollout_t *rollout = arg;
+    rng_t rng;
+    rng_seed(&rng, rng_mix_seed(rollout->seed, worker));
+    rollout_run_chunks(rollout, &rng);
+}
+
+/*
+    Sets the amount of threads rollout_suggest_move() plays with (1 plays on the calling thread only)
+    Pool threads are started once and sleep between moves, lowering the amount leaves the extra ones asleep
+*/
+void rollout_set_threads(int threads)
+{
+    if(threads < 1)
+    {
+        threads = 1;
+    }
+    if(threads > MAX_POOL_THREADS)
+    {
+        threads = MAX_POOL_THREADS;
+    }
+    if(threads > 1)
+    {
+        if(pool == NULL)
+        {
+            pool = thread_pool_init();
+        }
+        thread_pool_grow(pool, threads);
+    }
+    rollout_threads = threads;
+}
+
+/*
+    Suggests the next move for a 4x4 game by playing random games from each direction
+    Returns the direction with the best mean final points, NORTH if no direction changes the board
+*/
+int rollout_suggest_move(game_t *game)
+{
+    long long start = now_ns();
+    int parallel = rollout_threads > 1;
+    rollout_t *rollout = parallel ? &shared_rollout : &local_rollout;
+    rollout->dir_count = 0;
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        rollout_arm_t *arm = &rollout->arms[dir];
+        arm->points = 0;
+        uint8_t changed;
+        arm->board = bitboard_move_board(game->bitboard, dir, &arm->points, &changed);
+        atomic_store(&arm->count, 0);
+        atomic_store(&arm->sum, 0);
+        atomic_store(&arm->sum_squares, 0);
+        if(changed)
+        {
+            rollout->dirs[rollout->dir_count++] = dir;
+        }
+    }
+    if(rollout->dir_count <= 1) // nothing to choose between
+    {
+        return rollout->dir_count == 1 ? rollout->dirs[0] : NORTH;
+    }
+    long chunks_per_dir = (playout_budget + ROLLOUT_CHUNK - 1) / ROLLOUT_CHUNK;
+    rollout->chunk_limit = playout_budget > 0 ? chunks_per_dir * rollout->dir_count : LONG_MAX;
+    rollout->deadline = rollout_budget_ms > 0 ? start / 1e9 + rollout_budget_ms / 1000.0 : 0.0;
+    atomic_store(&rollout->next_chunk, 0);
+    atomic_store(&rollout->stop, 0);
+
+    if(parallel) // wake the pool, help with the chunks, then wait for the pool to finish
+    {
+        rollout->seed = rng_next(&game->policy_rng);
+        thread_pool_run(pool, rollout_threads, run_pool_chunks, rollout);
+    }
+    else // the game's policy generator keeps serial play reproducible
+    {
+        rollout_run_chunks(rollout, &game->policy_rng);
+    }
+
+    int best_dir = rollout->dirs[0];
+    double best = -1.0;
+    long playouts = 0;
+    for(int index = 0; index < rollout->dir_count; index++)
+    {
+        rollout_arm_t *arm = &rollout->arms[rollout->dirs[index]];
+        long count = atomic_load(&arm->count);
+        if(count == 0) // a deadline shorter than one chunk can leave directions without playouts
+        {
+            continue;
+        }
+        playouts += count;
+        double mean = (double)atomic_load(&arm->sum) / count;
+        if(mean > best)
+        {
+            best = mean;
+            best_dir = rollout->dirs[index];
+        }
+    }
+    atomic_fetch_add(&total_playouts, playouts);
+    atomic_fetch_add(&total_nanoseconds, now_ns() - start);
+    return best_dir;
+}
+
+// move policy wrapper so the rollout player can be used by the simulation driver
+int policy_rollout(game_t *game)
+{
+    if(game->size != BITBOARD_LENGTH) // playouts run on packed 4x4 bitboards only
+    {
+        return policy_corner_greedy(game);
+    }
+    return rollout_suggest_move(game);
+}
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE // accept4()
+#include "2048.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+    Game server: thousands of 4x4 game sessions in one process, played over a Unix socket
+
+    One thread runs an epoll loop over the listening socket and every client. Clients send
+    fixed-size requests (server_request_t, plus a seed or a list of directions for the
+    requests that need one) and get one server_response_t back for each, in order, so a
+    client may pipeline as many requests as it likes.
+
+    Nothing is allocated while serving: every session is a game of one preallocated game
+    pool, and every client gets a slot of a preallocated table with fixed input and output
+    buffers. A client whose output buffer fills up is not read from until it drains.
+
+    Session ids are the pool slot in the low 16 bits and the slot's generation above it,
+    so a request for a session that was closed (and maybe reused) gets SERVER_BAD_SESSION.
+
+    usage: ./server [socket] [sessions]
+*/
+
+// one connected client
+typedef struct
+{
+    int fd; // -1 when the slot is free
+    int in_length; // bytes in input that are not handled yet
+    int out_start; // first byte of output not written yet
+    int out_length; // end of the bytes in output
+    int writing; // 1 while waiting for EPOLLOUT to write the rest of output
+    uint8_t input[SERVER_BUFFER_SIZE];
+    uint8_t output[SERVER_BUFFER_SIZE];
+}
+server_client_t;
+
+static game_pool_t *sessions;
+static uint32_t *generations; // generation of each pool slot, bumped when its session is closed
+static uint8_t *in_use; // 1 for pool slots that hold an open session
+static int session_capacity;
+static server_client_t *clients;
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_on_signal(int signal_number)
+{
+    stopping = 1;
+}
+
+// returns the game of a session id, NULL if there is no such open session
+static game_t *session_game(uint32_t session)
+{
+    uint32_t slot = session & 0xFFFF;
+    if(slot >= (uint32_t)session_capacity || !in_use[slot] || generations[slot] != session >> 16)
+    {
+        return NULL;
+    }
+    return &sessions->blocks[slot].game;
+}
+
+// fills a response with the state of a game
+static void describe_game(server_response_t *response, game_t *game)
+{
+    response->running = game_running(game);
+    response->board = game->bitboard;
+    response->points = game->points;
+    response->highest_tile = game->highest_tile;
+}
+
+// moves a session's game and spawns a tile if it changed, returns 1 if it did
+static int session_move(game_t *game, int dir)
+{
+    if(!game_running(game) || !move_all(game, dir))
+    {
+        return 0;
+    }
+    place_random_tile(game);
+    return 1;
+}
+
+/*
+    Handles the request at the front of bytes, writes its response and returns the amount of bytes it used
+    Returns 0 if the request is not complete yet
+*/
+static int handle_request(uint8_t *bytes, int length, server_response_t *response)
+{
+    server_request_t request;
+    if(length < (int)sizeof(request))
+    {
+        return 0;
+    }
+    memcpy(&request, bytes, sizeof(request));
+    int used = sizeof(request);
+    memset(response, 0, sizeof(*response));
+    response->type = request.type;
+    response->session = request.session;
+    game_t *game = NULL;
+    switch(request.type)
+    {
+        case SERVER_NEW_GAME:
+        {
+            uint64_t seed;
+            if(length < used + (int)sizeof(seed))
+            {
+                return 0;
+            }
+            memcpy(&seed, bytes + used, sizeof(seed));
+            used += sizeof(seed);
+            game = game_pool_acquire(sessions);
+            if(game == NULL)
+            {
+                response->status = SERVER_FULL;
+                return used;
+            }
+            uint32_t slot = (game_block_t *)game - sessions->blocks;
+            in_use[slot] = 1;
+            response->session = generations[slot] << 16 | slot;
+            game_seed(game, seed);
+            place_random_tile(game); // place the two initial random tiles
+            place_random_tile(game);
+            break;
+        }
+        case SERVER_BATCH:
+            if(length < used + request.count)
+            {
+                return 0;
+            }
+            used += request.count;
+            if((game = session_game(request.session)) == NULL)
+            {
+                break;
+            }
+            for(int index = 0; index < request.count; index++)
+            {
+                if(bytes[sizeof(request) + index] > WEST)
+                {
+                    response->status = SERVER_BAD_REQUEST; // moves before the bad one stay applied
+                    break;
+                }
+                response->moved += session_move(game, bytes[sizeof(request) + index]);
+            }
+            break;
+        case SERVER_MOVE:
+            if((game = session_game(request.session)) != NULL)
+            {
+                if(request.dir > WEST)
+                {
+                    response->status = SERVER_BAD_REQUEST;
+                    break;
+                }
+                response->moved = session_move(game, request.dir);
+            }
+            break;
+        case SERVER_STATE:
+            game = session_game(request.session);
+            break;
+        case SERVER_CLOSE:
+            if((game = session_game(request.session)) != NULL)
+            {
+                uint32_t slot = request.session & 0xFFFF;
+                describe_game(response, game);
+                in_use[slot] = 0;
+                generations[slot] = (generations[slot] + 1) & 0xFFFF;
+                game_pool_release(sessions, game);
+                return used;
+            }
+            break;
+        default:
+            response->status = SERVER_BAD_REQUEST;
+            return used;
+    }
+    if(game == NULL)
+    {
+        response->status = SERVER_BAD_SESSION;
+        return used;
+    }
+    describe_game(response, game);
+    return used;
+}
+
+// closes a client and frees its slot
+static void drop_client(int epoll_fd, server_client_t *client)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+}
+
+/*
+    Writes as much of the client's output as the socket takes, then waits for EPOLLOUT
+    (and stops reading) if some is left, returns 0 if the client has to be dropped
+*/
+static int flush_client(int epoll_fd, server_client_t *client)
+{
+    while(client->out_start < client->out_length)
+    {
+        ssize_t written = write(client->fd, client->output + client->out_start, client->out_length - client->out_start);
+        if(written < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return 0;
+        }
+        client->out_start += written;
+    }
+    if(client->out_start == client->out_length)
+    {
+        client->out_start = 0;
+        client->out_length = 0;
+    }
+    int writing = client->out_length != 0;
+    if(writing != client->writing)
+    {
+        struct epoll_event event = {.events = writing ? EPOLLOUT : EPOLLIN, .data.ptr = client};
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+        client->writing = writing;
+    }
+    return 1;
+}
+
+/*
+    Handles every complete request in the client's input while its output has room for the response
+    Leftover bytes (a partial request, or requests waiting for room) are moved to the front of input
+*/
+static void serve_client(server_client_t *client)
+{
+    int offset = 0;
+    while(client->out_length + (int)sizeof(server_response_t) <= SERVER_BUFFER_SIZE)
+    {
+        server_response_t response;
+        int used = handle_request(client->input + offset, client->in_length - offset, &response);
+        if(used == 0)
+        {
+            break;
+        }
+        memcpy(client->output + client->out_length, &response, sizeof(response));
+        client->out_length += sizeof(response);
+        offset += used;
+    }
+    memmove(client->input, client->input + offset, client->in_length - offset);
+    client->in_length -= offset;
+}
+
+// reads what the client sent, serves it and writes the responses, returns 0 if the client has to be dropped
+static int read_client(int epoll_fd, server_client_t *client)
+{
+    while(client->in_length < SERVER_BUFFER_SIZE)
+    {
+        ssize_t received = read(client->fd, client->input + client->in_length, SERVER_BUFFER_SIZE - client->in_length);
+        if(received == 0)
+        {
+            return 0; // client hung up
+        }
+        if(received < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return 0;
+        }
+        client->in_length += received;
+        serve_client(client);
+        if(client->out_length > SERVER_BUFFER_SIZE / 2 && !flush_client(epoll_fd, client))
+        {
+            return 0;
+        }
+        if(client->writing)
+        {
+            return 1; // the rest is read once the client takes its responses
+        }
+    }
+    return flush_client(epoll_fd, client);
+}
+
+// takes every pending connection into a free client slot, connections past SERVER_MAX_CLIENTS are closed
+static void accept_clients(int epoll_fd, int listen_fd)
+{
+    int fd;
+    while((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        server_client_t *client = NULL;
+        for(int index = 0; index < SERVER_MAX_CLIENTS && client == NULL; index++)
+        {
+            if(clients[index].fd < 0)
+            {
+                client = &clients[index];
+            }
+        }
+        if(client == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->in_length = 0;
+        client->out_start = 0;
+        client->out_length = 0;
+        client->writing = 0;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+/*
+    This main method runs the game server
+    until it gets SIGINT or SIGTERM
+
+    usage: ./server [socket] [sessions]
+*/
+int main(int argc, char **argv)
+{
+    char *path = argc > 1 ? argv[1] : SERVER_SOCKET_PATH;
+    session_capacity = argc > 2 ? atoi(argv[2]) : 4096;
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if(session_capacity <= 0 || session_capacity > SERVER_MAX_SESSIONS || strlen(path) >= sizeof(address.sun_path))
+    {
+        printf("usage: %s [socket] [sessions (1 to %d)]\n", argv[0], SERVER_MAX_SESSIONS);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+
+    // every session and client buffer is allocated up front, serving never allocates
+    bitboard_init_tables();
+    sessions = game_pool_init(session_capacity, DEFAULT_BOARD_SIZE);
+    generations = calloc(session_capacity, sizeof(uint32_t));
+    in_use = calloc(session_capacity, sizeof(uint8_t));
+    clients = malloc(SERVER_MAX_CLIENTS * sizeof(server_client_t));
+    if(sessions == NULL || generations == NULL || in_use == NULL || clients == NULL)
+    {
+        printf("cannot allocate %d sessions\n", session_capacity);
+        return 1;
+    }
+    for(int index = 0; index < SERVER_MAX_CLIENTS; index++)
+    {
+        clients[index].fd = -1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(path); // a socket left behind by a server that was killed
+    if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        perror("cannot listen");
+        return 1;
+    }
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL}; // NULL marks the listening socket
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    struct sigaction action = {.sa_handler = stop_on_signal}; // no SA_RESTART, so epoll_wait returns on a signal
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN); // a client that hung up is noticed by write() failing instead
+    printf("serving %d sessions on %s\n", session_capacity, path);
+    fflush(stdout);
+
+    struct epoll_event events[64];
+    while(!stopping)
+    {
+        int ready = epoll_wait(epoll_fd, events, 64, -1);
+        for(int index = 0; index < ready; index++)
+        {
+            server_client_t *client = events[index].data.ptr;
+            if(client == NULL)
+            {
+                accept_clients(epoll_fd, listen_fd);
+                continue;
+            }
+            int alive = !(events[index].events & (EPOLLERR | EPOLLHUP)) || (events[index].events & EPOLLIN);
+            if(alive && (events[index].events & EPOLLOUT))
+            {
+                // once the responses are written, the requests waiting for room are served and reading resumes
+                alive = flush_client(epoll_fd, client);
+                if(alive && !client->writing)
+                {
+                    serve_client(client);
+                    alive = read_client(epoll_fd, client);
+                }
+            }
+            else if(alive)
+            {
+                alive = read_client(epoll_fd, client);
+            }
+            if(!alive)
+            {
+                drop_client(epoll_fd, client);
+            }
+        }
+    }
+
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(path);
+    printf("server stopped\n");
+    return 0;
+}
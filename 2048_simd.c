@@ -0,0 +1,260 @@
+#include "2048.h"
+
+/*
+    Whole-board move kernels for the packed bitboard
+
+    bitboard_move() looks every row up in a transition table, one row at a time. The vector
+    kernels below instead unpack all 16 cell exponents into the 16 bytes of one SSE register
+    (byte row * 4 + col) and move the four rows at once:
+
+    1. the direction is turned into WEST with one byte shuffle (mirror rows for EAST,
+       transpose for NORTH, both for SOUTH), and turned back the same way at the end
+    2. tiles are slid towards col 0 with a shuffle picked by the empty cells of each row
+    3. equal neighbours are compared in parallel, the first of each pair is incremented and
+       the second cleared, and the tiles are slid again to close the gaps left by merges
+    4. the points of the merged tiles are looked up with shuffles and summed with psadbw
+
+    Merges follow the row tables exactly (each tile merges once, 32768s never merge), so
+    every kernel gives the same board and points as bitboard_move() for every board.
+
+    bitboard_init_tables() picks the kernel once, from what the CPU supports (AVX2, then SSE4.1,
+    then the scalar table loop), before any thread can move a board, so bitboard_move_board()
+    only reads it. bitboard_use_kernel() can force one by name for tests and benchmarks, it must
+    not be called while other threads are moving boards.
+*/
+
+typedef board_t (*board_kernel_t)(board_t board, int dir, int *points, uint8_t *changedP);
+
+static board_t move_board_scalar(board_t board, int dir, int *points, uint8_t *changedP);
+
+// kernel bitboard_move_board() runs, set by bitboard_init_kernels()
+static board_kernel_t board_kernel = move_board_scalar;
+static char *board_kernel_name = "scalar";
+
+/*
+    Moves all rows/cols of the board one row at a time through the row tables, used where there is no vector kernel
+    Points gained are added to *points, *changedP gets bit i set if row/col i changed
+*/
+static board_t move_board_scalar(board_t board, int dir, int *points, uint8_t *changedP)
+{
+    int transposed = (dir == NORTH || dir == SOUTH);
+    if(transposed) // columns become rows
+    {
+        board = bitboard_transpose(board);
+    }
+    board_t result = 0;
+    uint8_t changed = 0;
+    for(int line = 0; line < BITBOARD_LENGTH; line++)
+    {
+        uint16_t row = (board >> (line * ROW_BITS)) & ROW_MASK;
+        uint16_t moved = (dir == WEST || dir == NORTH) ? bitboard_move_row_west(row, points) : bitboard_move_row_east(row, points);
+        result |= (board_t)moved << (line * ROW_BITS);
+        changed |= (moved != row) << line;
+    }
+    *changedP = changed;
+    return transposed ? bitboard_transpose(result) : result;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+/*
+    Shuffle controls that slide the tiles of two rows (8 bytes) towards col 0,
+    indexed by the mask of empty cells of those rows; slots left over are zeroed (0x80)
+*/
+static uint64_t slide_shuffles[256];
+
+// shuffles that turn each direction into WEST, and the ones that turn the result back
+static const uint8_t to_west[4][16] =
+{
+    [NORTH] = {0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15},
+    [SOUTH] = {12, 8, 4, 0, 13, 9, 5, 1, 14, 10, 6, 2, 15, 11, 7, 3},
+    [EAST] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    [WEST] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+};
+static const uint8_t from_west[4][16] =
+{
+    [NORTH] = {0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15},
+    [SOUTH] = {3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12},
+    [EAST] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    [WEST] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+};
+
+// low and high bytes of the tile value of each exponent, looked up with a shuffle to score merges
+static const uint8_t tile_low[16] = {0, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t tile_high[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, 128};
+
+// bytes of the last col of every row, the only cells that have no neighbour to merge with
+static const uint8_t last_col[16] = {0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF};
+
+// fills slide_shuffles, called once by bitboard_init_kernels()
+static void build_slide_shuffles()
+{
+    for(int empty = 0; empty < 256; empty++)
+    {
+        uint8_t shuffle[8];
+        for(int half = 0; half < 2; half++)
+        {
+            int length = 0;
+            for(int col = 0; col < BITBOARD_LENGTH; col++)
+            {
+                if(!(empty & (1 << (half * 4 + col))))
+                {
+                    shuffle[half * 4 + length++] = half * 4 + col;
+                }
+            }
+            while(length < BITBOARD_LENGTH)
+            {
+                shuffle[half * 4 + length++] = 0x80;
+            }
+        }
+        memcpy(&slide_shuffles[empty], shuffle, sizeof(shuffle));
+    }
+}
+
+// slides the tiles of every row towards col 0
+static inline __attribute__((always_inline, target("sse4.1"))) __m128i slide_west(__m128i cells)
+{
+    int empty = _mm_movemask_epi8(_mm_cmpeq_epi8(cells, _mm_setzero_si128()));
+    __m128i shuffle = _mm_set_epi64x(slide_shuffles[empty >> 8] | 0x0808080808080808ULL, slide_shuffles[empty & 0xFF]);
+    return _mm_shuffle_epi8(cells, shuffle);
+}
+
+/*
+    Moves the whole board in dir inside one register, generic routine instantiated by the SSE4.1 and AVX2 kernels
+    Points gained are added to *points, *changedP gets bit i set if row/col i changed
+*/
+static inline __attribute__((always_inline, target("sse4.1"))) board_t move_board_vector(board_t board, int dir,
+    int *points, uint8_t *changedP)
+{
+    // unpack: byte 2k gets the low nibble of board byte k and byte 2k + 1 its high nibble
+    __m128i nibbles = _mm_cvtsi64_si128(board);
+    __m128i low_mask = _mm_set1_epi8(0x0F);
+    __m128i cells = _mm_unpacklo_epi8(_mm_and_si128(nibbles, low_mask), _mm_and_si128(_mm_srli_epi16(nibbles, 4), low_mask));
+    __m128i original = _mm_shuffle_epi8(cells, _mm_loadu_si128((__m128i *)to_west[dir]));
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i slid = slide_west(original);
+    // a cell merges with its right neighbour if both hold the same tile, unless it is empty, a 32768 or in the last col
+    __m128i blocked = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(slid, zero), _mm_cmpeq_epi8(slid, low_mask)),
+        _mm_loadu_si128((__m128i *)last_col));
+    __m128i equal = _mm_andnot_si128(blocked, _mm_cmpeq_epi8(slid, _mm_srli_si128(slid, 1)));
+    // a tile merged into its left neighbour cannot merge again: pairs are taken left to right
+    __m128i first = _mm_andnot_si128(_mm_slli_si128(equal, 1), equal);
+    __m128i merges = _mm_andnot_si128(_mm_slli_si128(first, 1), equal);
+    __m128i merged = _mm_andnot_si128(_mm_slli_si128(merges, 1), _mm_sub_epi8(slid, merges));
+    __m128i result = slide_west(merged);
+
+    // points: tile value of every merged cell, split in bytes and summed per 8 lanes
+    __m128i scored = _mm_and_si128(merged, merges);
+    __m128i low = _mm_sad_epu8(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *)tile_low), scored), zero);
+    __m128i high = _mm_sad_epu8(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *)tile_high), scored), zero);
+    __m128i sums = _mm_add_epi64(low, _mm_slli_epi64(high, 8));
+    *points += _mm_cvtsi128_si32(sums) + _mm_extract_epi32(sums, 2);
+
+    // each row is one 32-bit lane, so a compare of lanes gives the changed mask of the lines
+    *changedP = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(result, original))) & 0xF;
+
+    // pack: turn back to dir, then each pair of bytes becomes one byte (low + high * 16)
+    result = _mm_shuffle_epi8(result, _mm_loadu_si128((__m128i *)from_west[dir]));
+    __m128i packed = _mm_maddubs_epi16(result, _mm_set1_epi16(0x1001));
+    return _mm_cvtsi128_si64(_mm_packus_epi16(packed, packed));
+}
+
+static __attribute__((target("sse4.1"))) board_t move_board_sse4(board_t board, int dir, int *points, uint8_t *changedP)
+{
+    return move_board_vector(board, dir, points, changedP);
+}
+
+// same instructions in their VEX encoding, which saves a register copy per operation and never mixes with AVX code
+static __attribute__((target("avx2"))) board_t move_board_avx2(board_t board, int dir, int *points, uint8_t *changedP)
+{
+    return move_board_vector(board, dir, points, changedP);
+}
+
+#endif
+
+// kernels by name, best first
+static struct
+{
+    char *name;
+    board_kernel_t kernel;
+}
+board_kernels[] =
+{
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx2", move_board_avx2},
+    {"sse4", move_board_sse4},
+#endif
+    {"scalar", move_board_scalar},
+};
+
+#define KERNEL_COUNT (int)(sizeof(board_kernels) / sizeof(board_kernels[0]))
+
+// returns 1 if the CPU can run the kernel at index
+static int kernel_supported(int index)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(strcmp(board_kernels[index].name, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if(strcmp(board_kernels[index].name, "sse4") == 0)
+    {
+        return __builtin_cpu_supports("sse4.1");
+    }
+#endif
+    return 1;
+}
+
+// builds the shuffles of the vector kernels and installs the best kernel the CPU supports, run once by bitboard_init_tables()
+void bitboard_init_kernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    build_slide_shuffles();
+#endif
+    for(int index = 0; index < KERNEL_COUNT; index++)
+    {
+        if(kernel_supported(index))
+        {
+            board_kernel_name = board_kernels[index].name;
+            board_kernel = board_kernels[index].kernel;
+            break;
+        }
+    }
+}
+
+/*
+    Moves all rows/cols of the board in dir with one whole-board kernel, same result as bitboard_move()
+    bitboard_init_tables() has to be called first, like for bitboard_move()
+    Points gained are added to *points, *changedP gets bit i set if row (EAST/WEST) or col (NORTH/SOUTH) i changed
+*/
+board_t bitboard_move_board(board_t board, int dir, int *points, uint8_t *changedP)
+{
+    return board_kernel(board, dir, points, changedP);
+}
+
+// returns the name of the kernel bitboard_move_board() runs on
+char *bitboard_kernel_name()
+{
+    bitboard_init_tables();
+    return board_kernel_name;
+}
+
+// makes bitboard_move_board() run the named kernel ("avx2", "sse4" or "scalar"), returns 0 if this CPU cannot run it
+int bitboard_use_kernel(char *name)
+{
+    bitboard_init_tables();
+    for(int index = 0; index < KERNEL_COUNT; index++)
+    {
+        if(strcmp(board_kernels[index].name, name) == 0 && kernel_supported(index))
+        {
+            board_kernel_name = board_kernels[index].name;
+            board_kernel = board_kernels[index].kernel;
+            return 1;
+        }
+    }
+    return 0;
+}
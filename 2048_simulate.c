@@ -0,0 +1,331 @@
+#include "2048.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// amount of distinct tile exponents an int board can hold (EMPTY through 2^30), packed 4x4 boards stop at 32768
+// but the merges of other board sizes are not capped
+#define TILE_EXPONENTS 31
+
+// amount of games a worker takes from its own queue at a time
+#define CHUNK_GAMES 16
+
+// maximum amount of worker threads
+#define MAX_THREADS 256
+
+// aggregate statistics collected over a batch of simulated games
+typedef struct
+{
+    long games; // amount of games played to completion
+    long moves; // amount of moves that changed the board
+    long long total_points; // points summed over all games
+    int *scores; // final points of each game, used for the score distribution
+    long tile_counts[TILE_EXPONENTS]; // amount of games whose highest tile had each exponent
+}
+sim_stats_t;
+
+/*
+    state of one worker thread
+
+    queue holds the range of game indices the worker still owns, packed as (begin << 32 | end)
+    so the owner taking from the front and thieves taking from the back both update it with one CAS
+
+    stats are only written by the owning thread and merged after all threads join, so no locks are needed
+*/
+typedef struct
+{
+    _Atomic uint64_t queue; // packed [begin, end) range of games still owned by this worker
+    sim_stats_t stats; // counters of the games this worker played
+    game_t *game; // game reused for every game this worker plays, taken from the batch's pool
+    dataset_writer_t *writer; // writer for the moves of this worker's games, NULL if none are exported
+    pthread_t thread;
+    int id;
+    char padding[64]; // keeps neighbouring workers' hot fields off the same cache line
+}
+sim_worker_t;
+
+// settings shared by every worker of a batch
+typedef struct
+{
+    sim_worker_t *workers;
+    int threads;
+    uint64_t seed;
+    move_policy_t policy;
+    int *scores; // final points of each game, slot i is only written by the worker that played game i
+    game_pool_t *games; // one preallocated game per worker
+    dataset_file_t *dataset; // file every move is exported to, NULL if none are exported
+}
+sim_batch_t;
+
+sim_batch_t batch;
+
+/*
+    Plays one game to completion with the given policy, without any terminal I/O
+    A random tile is only placed after a move that changed the board
+    If writer is not NULL every move is appended to it as a dataset row
+
+    Returns the amount of moves made
+*/
+long play_game(game_t *game, move_policy_t policy, dataset_writer_t *writer)
+{
+    long moves = 0;
+    place_random_tile(game);
+    place_random_tile(game);
+    while(game_running(game))
+    {
+        game->game_status = RUNNING;
+        board_t before = game->bitboard;
+        int points = game->points;
+        int dir = policy(game);
+        if(move_all(game, dir))
+        {
+            place_random_tile(game);
+            moves++;
+        }
+        if(writer != NULL)
+        {
+            dataset_writer_add(writer, before, dir, game->points - points, !game_running(game));
+        }
+    }
+    return moves;
+}
+
+// packs a [begin, end) range of game indices into one queue word
+uint64_t pack_range(uint32_t begin, uint32_t end)
+{
+    return ((uint64_t)begin << 32) | end;
+}
+
+/*
+    Takes up to CHUNK_GAMES games from the front of the worker's own queue
+    Returns 1 and sets *beginP and *endP on success, returns 0 if the queue is empty
+*/
+int take_own_games(sim_worker_t *worker, uint32_t *beginP, uint32_t *endP)
+{
+    uint64_t range = atomic_load(&worker->queue);
+    while(1)
+    {
+        uint32_t begin = range >> 32;
+        uint32_t end = (uint32_t)range;
+        if(begin >= end)
+        {
+            return 0;
+        }
+        uint32_t taken = end - begin < CHUNK_GAMES ? end : begin + CHUNK_GAMES;
+        if(atomic_compare_exchange_weak(&worker->queue, &range, pack_range(taken, end)))
+        {
+            *beginP = begin;
+            *endP = taken;
+            return 1;
+        }
+    }
+}
+
+/*
+    Steals the back half of another worker's queue and makes it the thief's own queue
+    Victims are tried in order starting after the thief; returns 0 once every queue is empty
+*/
+int steal_games(sim_worker_t *thief)
+{
+    for(int offset = 1; offset < batch.threads; offset++)
+    {
+        sim_worker_t *victim = &batch.workers[(thief->id + offset) % batch.threads];
+        uint64_t range = atomic_load(&victim->queue);
+        while(1)
+        {
+            uint32_t begin = range >> 32;
+            uint32_t end = (uint32_t)range;
+            if(begin >= end)
+            {
+                break; // nothing to steal here, try the next victim
+            }
+            uint32_t middle = begin + (end - begin) / 2;
+            if(atomic_compare_exchange_weak(&victim->queue, &range, pack_range(begin, middle)))
+            {
+                atomic_store(&thief->queue, pack_range(middle, end));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+    Plays every game in [begin, end), each seeded from its own index so results do not depend on scheduling
+    The worker's game is reset in place between games, so no allocations happen here
+*/
+void play_games(sim_worker_t *worker, uint32_t begin, uint32_t end)
+{
+    game_t *game = worker->game;
+    for(uint32_t index = begin; index < end; index++)
+    {
+        game_reset(game);
+        game_seed(game, rng_mix_seed(batch.seed, index));
+        worker->stats.moves += play_game(game, batch.policy, worker->writer);
+        batch.scores[index] = game->points;
+        worker->stats.total_points += game->points;
+        worker->stats.tile_counts[__builtin_ctz(game->highest_tile)]++;
+        worker->stats.games++;
+    }
+}
+
+// thread body: play own games, then steal from other workers until every queue is empty
+void *sim_worker_run(void *arg)
+{
+    sim_worker_t *worker = arg;
+    uint32_t begin, end;
+    do
+    {
+        while(take_own_games(worker, &begin, &end))
+        {
+            play_games(worker, begin, end);
+        }
+    }
+    while(steal_games(worker));
+    move_cache_flush_stats();
+    return NULL;
+}
+
+// comparison function for sorting scores with qsort
+int compare_scores(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// prints games/sec, moves/sec, the score distribution and the highest tile histogram
+void print_stats(sim_stats_t *stats, double seconds)
+{
+    qsort(stats->scores, stats->games, sizeof(int), compare_scores);
+    printf("games: %ld\n", stats->games);
+    printf("moves: %ld\n", stats->moves);
+    printf("seconds: %.3f\n", seconds);
+    printf("games/sec: %.1f\n", stats->games / seconds);
+    printf("moves/sec: %.1f\n", stats->moves / seconds);
+    printf("\nscore min: %d\n", stats->scores[0]);
+    printf("score p50: %d\n", stats->scores[stats->games / 2]);
+    printf("score p90: %d\n", stats->scores[stats->games * 9 / 10]);
+    printf("score p99: %d\n", stats->scores[stats->games * 99 / 100]);
+    printf("score max: %d\n", stats->scores[stats->games - 1]);
+    printf("score mean: %.1f\n", (double)stats->total_points / stats->games);
+    printf("\nHIGHEST_TILE  GAMES  PERCENT\n");
+    for(int exponent = 1; exponent < TILE_EXPONENTS; exponent++)
+    {
+        if(stats->tile_counts[exponent] == 0)
+        {
+            continue;
+        }
+        printf("%12d  %5ld  %6.2f%%\n", 1 << exponent, stats->tile_counts[exponent],
+            100.0 * stats->tile_counts[exponent] / stats->games);
+    }
+}
+
+/*
+    This main method runs a batch of complete
+    2048 games headlessly so the engine can be
+    put under load.
+
+    usage: ./simulate [games] [seed] [policy] [threads] [ms] [dataset|-] [size]
+    policy is one of "random", "corner", "expectimax", "rollout" or "ntuple" (weights from "ntuple.weights"), threads defaults to the amount of cores
+    ms is the search time of each expectimax or rollout move, every move is exported to the dataset file if one is given ("-" for none)
+    size is the amount of tiles on each side of the board (3 to 6, default 4), datasets need 4x4 boards
+*/
+int main(int argc, char **argv)
+{
+    long games = argc > 1 ? atol(argv[1]) : 1000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : (uint64_t)time(NULL);
+    char *policy_name = argc > 3 ? argv[3] : "random";
+    int threads = argc > 4 ? atoi(argv[4]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(argc > 5)
+    {
+        ai_set_time_budget(atoi(argv[5]));
+        rollout_set_budget(ROLLOUT_DEFAULT_PLAYOUTS, atoi(argv[5]));
+    }
+    char *dataset_path = argc > 6 && strcmp(argv[6], "-") != 0 ? argv[6] : NULL;
+    int size = argc > 7 ? atoi(argv[7]) : DEFAULT_BOARD_SIZE;
+    move_policy_t policy = policy_by_name(policy_name);
+    if(policy == NULL || games <= 0 || games > UINT32_MAX || threads <= 0 || threads > MAX_THREADS ||
+        size < MIN_BOARD_SIZE || size > MAX_BOARD_SIZE || (dataset_path != NULL && size != BITBOARD_LENGTH))
+    {
+        printf("usage: %s [games] [seed] [random|corner|expectimax|rollout|ntuple] [threads] [ms] [dataset|-] [size]\n", argv[0]);
+        return 1;
+    }
+    batch.dataset = NULL;
+    if(dataset_path != NULL && (batch.dataset = dataset_file_create(dataset_path)) == NULL)
+    {
+        printf("cannot create %s\n", dataset_path);
+        return 1;
+    }
+    printf("policy: %s, seed: %llu, threads: %d, board: %dx%d\n", policy_name, (unsigned long long)seed, threads, size, size);
+
+    // build the lookup tables before any worker thread could race to build them
+    bitboard_init_tables();
+    if(!eval_load_weights("weights.cfg")) // built-in weights are kept if there is no config file
+    {
+        eval_init_tables();
+    }
+    if(policy == policy_ntuple && !ntuple_use_weights(NTUPLE_DEFAULT_PATH)) // plays corner-greedy without trained weights
+    {
+        printf("cannot map %s, playing corner-greedy instead\n", NTUPLE_DEFAULT_PATH);
+    }
+
+    // split the games evenly between the workers, stealing balances whatever is left over
+    batch.workers = calloc(threads, sizeof(sim_worker_t));
+    batch.threads = threads;
+    batch.seed = seed;
+    batch.policy = policy;
+    batch.scores = malloc(sizeof(int) * games);
+    batch.games = game_pool_init(threads, size);
+    for(int id = 0; id < threads; id++)
+    {
+        batch.workers[id].id = id;
+        batch.workers[id].game = game_pool_acquire(batch.games);
+        batch.workers[id].writer = batch.dataset != NULL ? dataset_writer_init(batch.dataset) : NULL;
+        atomic_init(&batch.workers[id].queue, pack_range(games * id / threads, games * (id + 1) / threads));
+    }
+
+    long long start = now_ns();
+    for(int id = 0; id < threads; id++)
+    {
+        pthread_create(&batch.workers[id].thread, NULL, sim_worker_run, &batch.workers[id]);
+    }
+    sim_stats_t stats = {0};
+    for(int id = 0; id < threads; id++)
+    {
+        pthread_join(batch.workers[id].thread, NULL);
+        // merge the worker's counters now that it can no longer write to them
+        sim_stats_t *worker_stats = &batch.workers[id].stats;
+        if(batch.workers[id].writer != NULL)
+        {
+            dataset_writer_free(batch.workers[id].writer); // writes the worker's last partly filled block
+        }
+        stats.games += worker_stats->games;
+        stats.moves += worker_stats->moves;
+        stats.total_points += worker_stats->total_points;
+        for(int exponent = 0; exponent < TILE_EXPONENTS; exponent++)
+        {
+            stats.tile_counts[exponent] += worker_stats->tile_counts[exponent];
+        }
+    }
+    if(batch.dataset != NULL && !dataset_file_close(batch.dataset))
+    {
+        printf("failed to write %s\n", dataset_path);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    stats.scores = batch.scores;
+    print_stats(&stats, seconds);
+    printf("games/sec per thread: %.1f\n", stats.games / seconds / threads);
+    long hits, misses;
+    move_cache_stats(&hits, &misses);
+    printf("move cache: %ld hits, %ld misses (%.1f%% hit rate)\n", hits, misses,
+        hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+    long playouts;
+    double rollout_seconds;
+    rollout_stats(&playouts, &rollout_seconds);
+    if(playouts > 0) // each worker plays its own rollouts, so this is the rate of one thread
+    {
+        printf("rollouts: %ld, rollouts/sec per thread: %.1f\n", playouts, playouts / rollout_seconds);
+    }
+    free(batch.scores);
+    free(batch.workers);
+    game_pool_free(batch.games);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "2048.h"
+
+/*
+    Symmetries of packed 4x4 bitboards
+
+    A square board has 8 symmetries (the dihedral group): the identity, three rotations and
+    four mirrors. Every one of them is some combination of three bit tricks on the packed
+    board, applied in this order: a transpose (SYMMETRY_TRANSPOSE), reversing the order of the
+    rows (SYMMETRY_FLIP) and reversing the cells of every row (SYMMETRY_MIRROR). A transform is
+    the OR of the ones it applies, so transforms are numbered 0 to 7.
+
+    The rules of the game do not change under any of them, a transform only renames the
+    directions, so boards that are symmetries of each other have the same moves, points and
+    chances. bitboard_canonical() picks the smallest of the 8 boards as the representative, so
+    tables keyed by it need up to 8 times fewer entries, and a move made on the representative
+    is mapped back with symmetry_map_dir() and symmetry_inverse().
+*/
+
+// same as bitboard_transpose(), kept here so the transforms below are inlined into one function
+static board_t transpose(board_t board)
+{
+    board_t a1 = board & 0xF0F00F0FF0F00F0FULL;
+    board_t a2 = board & 0x0000F0F00000F0F0ULL;
+    board_t a3 = board & 0x0F0F00000F0F0000ULL;
+    board_t a = a1 | (a2 << 12) | (a3 >> 12);
+    board_t b1 = a & 0xFF00FF0000FF00FFULL;
+    board_t b2 = a & 0x00FF00FF00000000ULL;
+    board_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+// reverses the order of the rows, row 0 becomes row 3
+static board_t flip_rows(board_t board)
+{
+    board = (board >> 32) | (board << 32);
+    return ((board >> 16) & 0x0000FFFF0000FFFFULL) | ((board & 0x0000FFFF0000FFFFULL) << 16);
+}
+
+// reverses the cells of every row, col 0 becomes col 3
+static board_t mirror_cols(board_t board)
+{
+    board = ((board >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((board & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return ((board >> 8) & 0x00FF00FF00FF00FFULL) | ((board & 0x00FF00FF00FF00FFULL) << 8);
+}
+
+// applies a transform (an OR of SYMMETRY_TRANSPOSE, SYMMETRY_FLIP and SYMMETRY_MIRROR) to a board
+board_t bitboard_transform(board_t board, int transform)
+{
+    if(transform & SYMMETRY_TRANSPOSE)
+    {
+        board = transpose(board);
+    }
+    if(transform & SYMMETRY_FLIP)
+    {
+        board = flip_rows(board);
+    }
+    if(transform & SYMMETRY_MIRROR)
+    {
+        board = mirror_cols(board);
+    }
+    return board;
+}
+
+/*
+    Returns the transform that undoes the given one
+    Each step undoes itself, but undoing them in reverse order puts the transpose last,
+    and mirroring before a transpose is the same as flipping after it (and the other way around)
+*/
+int symmetry_inverse(int transform)
+{
+    if(!(transform & SYMMETRY_TRANSPOSE))
+    {
+        return transform;
+    }
+    return SYMMETRY_TRANSPOSE | ((transform & SYMMETRY_MIRROR) << 1) | ((transform & SYMMETRY_FLIP) >> 1);
+}
+
+/*
+    Returns the direction that does on the transformed board what dir does on the original one
+    The step of dir (dir_x/dir_y) goes through the same transform as the cells
+*/
+int symmetry_map_dir(int dir, int transform)
+{
+    int x = dir_x[dir];
+    int y = dir_y[dir];
+    if(transform & SYMMETRY_TRANSPOSE)
+    {
+        int swap = x;
+        x = y;
+        y = swap;
+    }
+    if(transform & SYMMETRY_FLIP)
+    {
+        y = -y;
+    }
+    if(transform & SYMMETRY_MIRROR)
+    {
+        x = -x;
+    }
+    for(dir = NORTH; dir <= WEST; dir++)
+    {
+        if(dir_x[dir] == x && dir_y[dir] == y)
+        {
+            break;
+        }
+    }
+    return dir;
+}
+
+/*
+    Returns the smallest of the 8 symmetries of a board, every symmetric board gives the same one
+    *transformP (if not NULL) is set to the transform that turns board into it, the lowest one on ties
+*/
+board_t bitboard_canonical(board_t board, int *transformP)
+{
+    board_t transposed = transpose(board);
+    board_t boards[8];
+    boards[0] = board;
+    boards[SYMMETRY_MIRROR] = mirror_cols(board);
+    boards[SYMMETRY_FLIP] = flip_rows(board);
+    boards[SYMMETRY_FLIP | SYMMETRY_MIRROR] = flip_rows(boards[SYMMETRY_MIRROR]);
+    boards[SYMMETRY_TRANSPOSE] = transposed;
+    boards[SYMMETRY_TRANSPOSE | SYMMETRY_MIRROR] = mirror_cols(transposed);
+    boards[SYMMETRY_TRANSPOSE | SYMMETRY_FLIP] = flip_rows(transposed);
+    boards[SYMMETRY_TRANSPOSE | SYMMETRY_FLIP | SYMMETRY_MIRROR] = flip_rows(boards[SYMMETRY_TRANSPOSE | SYMMETRY_MIRROR]);
+    int best = 0;
+    for(int transform = 1; transform < 8; transform++)
+    {
+        if(boards[transform] < boards[best])
+        {
+            best = transform;
+        }
+    }
+    if(transformP != NULL)
+    {
+        *transformP = best;
+    }
+    return boards[best];
+}
+
+// hashes a board so that all 8 of its symmetries get the same 64 bits, take the top bits for a table index
+uint64_t bitboard_symmetric_hash(board_t board)
+{
+    return bitboard_canonical(board, NULL) * 0x9E3779B97F4A7C15ULL;
+}
+
+/*
+    Moves a board through its canonical board: the move is made on the representative in the
+    mapped direction and the result is transformed back, so a table of canonical moves serves
+    every symmetry. Gives the same board and points as bitboard_move_board(), *movedP is set to 1 if the board changed
+*/
+board_t bitboard_move_canonical(board_t board, int dir, int *points, int *movedP)
+{
+    int transform;
+    board_t canonical = bitboard_canonical(board, &transform);
+    uint8_t changed; // lines of the canonical board, which are not the lines of board
+    board_t moved = bitboard_move_board(canonical, symmetry_map_dir(dir, transform), points, &changed);
+    *movedP = changed != 0;
+    return bitboard_transform(moved, symmetry_inverse(transform));
+}
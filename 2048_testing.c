@@ -1,4 +1,5 @@
 #include "2048.h"
+#include <stdatomic.h>
 
 void test_list();
 void test_game_init();
@@ -7,18 +8,108 @@ void test_move_one_tile();
 void test_combine_tile();
 void test_move_call_north();
 void test_move_call_south();
+void test_bitboard();
+void test_legal_moves();
+void test_dataset();
+void test_board_sizes();
+void test_batch();
+void test_history();
+void test_rollout();
+void test_symmetry();
+void test_ntuple();
+void test_thread_pool();
+
+// tests by the name main() runs them under
+static struct
+{
+    char *name;
+    void (*run)();
+}
+tests[] =
+{
+    {"list", test_list},
+    {"game_init", test_game_init},
+    {"place_tile", test_place_tile},
+    {"move_one_tile", test_move_one_tile},
+    {"combine_tile", test_combine_tile},
+    {"move_call_north", test_move_call_north},
+    {"move_call_south", test_move_call_south},
+    {"bitboard", test_bitboard},
+    {"legal_moves", test_legal_moves},
+    {"dataset", test_dataset},
+    {"board_sizes", test_board_sizes},
+    {"batch", test_batch},
+    {"history", test_history},
+    {"rollout", test_rollout},
+    {"symmetry", test_symmetry},
+    {"ntuple", test_ntuple},
+    {"thread_pool", test_thread_pool},
+};
+
+#define TEST_COUNT (int)(sizeof(tests) / sizeof(tests[0]))
 
 /*
     This file is meant for testing
     specific functionality of the 
     2048 game implementation 
+
+    usage: ./testing [test ...]
+    runs the named tests ("all" runs every one of them), move_call_south if none is named
 */
 int main(int argc, char **argv)
 {
-    test_move_call_south();
+    if(argc < 2)
+    {
+        test_move_call_south();
+        return 0;
+    }
+    for(int arg = 1; arg < argc; arg++)
+    {
+        int found = 0;
+        for(int index = 0; index < TEST_COUNT; index++)
+        {
+            if(strcmp(argv[arg], "all") == 0 || strcmp(argv[arg], tests[index].name) == 0)
+            {
+                printf("== %s\n", tests[index].name);
+                tests[index].run();
+                found = 1;
+            }
+        }
+        if(!found)
+        {
+            printf("unknown test: %s, tests are:", argv[arg]);
+            for(int index = 0; index < TEST_COUNT; index++)
+            {
+                printf(" %s", tests[index].name);
+            }
+            printf("\n");
+            return 1;
+        }
+    }
     return 0;
 } 
 
+// starts a seeded 4x4 game with its first two tiles, the game the tests below walk through
+static game_t *random_game_init(uint64_t seed)
+{
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
+    game_seed(game, seed);
+    place_random_tile(game);
+    place_random_tile(game);
+    return game;
+}
+
+// makes one random move and places a tile if it changed the board, returns 1 if it did
+static int random_game_step(game_t *game)
+{
+    if(!move_all(game, policy_random(game)))
+    {
+        return 0;
+    }
+    place_random_tile(game);
+    return 1;
+}
+
 // tests basic functionality of empty_list which is a core requirement for making 2048 work
 void test_list()
 {
@@ -32,9 +123,11 @@ void test_list()
     }
     int row;
     int col;
+    rng_t rng;
+    rng_seed(&rng, time(NULL));
     for(int i = 0; i < 10; i++)
     {
-        empty_list_get_random(list, &row, &col);
+        empty_list_get_random(list, &rng, &row, &col);
         printf("%d, %d\n", row, col);
     }
     empty_list_print(list);
@@ -52,7 +145,7 @@ void test_list()
 // tests game initialization and free
 void test_game_init()
 {
-    game_t *game = game_init();
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
     game_print(game, LOGGING);
     game_free(game);
 }
@@ -60,7 +153,7 @@ void test_game_init()
 void test_place_tile()
 {
     srand(time(NULL)); // ensure that the random index is a random one from the list
-    game_t *game = game_init();
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
     for(int i = 0; i < 16; i++)
     {
         place_random_tile(game);
@@ -71,7 +164,7 @@ void test_place_tile()
 
 void test_move_one_tile()
 {
-    game_t *game = game_init();
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
     game_print(game, LOGGING);
     game->board[1][1] = 2;
     game_print(game, LOGGING);
@@ -88,7 +181,7 @@ void test_move_one_tile()
 
 void test_combine_tile()
 {
-    game_t *game = game_init();
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
     game_print(game, LOGGING);
     game->board[1][1] = 2;
     game->board[1][4] = 2;
@@ -100,7 +193,7 @@ void test_combine_tile()
 
 void test_move_call_north()
 {
-    game_t *game = game_init();
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
     game_print(game, LOGGING);
     game->board[4][1] = 2;
     game->board[2][2] = 2;
@@ -112,6 +205,7 @@ void test_move_call_north()
     game->board[2][4] = 2;
     game->board[3][4] = 2;
     game->board[4][4] = 2;
+    game_pack_board(game); // cells were set directly, sync the bitboard before moving
     game_print(game, LOGGING);
     move_all(game, NORTH);
     game_print(game, LOGGING);
@@ -120,7 +214,7 @@ void test_move_call_north()
 
 void test_move_call_south()
 {
-    game_t *game = game_init();
+    game_t *game = game_init(DEFAULT_BOARD_SIZE);
     game_print(game, LOGGING);
     game->board[1][1] = 2;
     game->board[1][2] = 2;
@@ -132,8 +226,430 @@ void test_move_call_south()
     game->board[2][4] = 2;
     game->board[3][4] = 2;
     game->board[4][4] = 2;
+    game_pack_board(game); // cells were set directly, sync the bitboard before moving
     game_print(game, LOGGING);
     move_all(game, SOUTH);
     game_print(game, LOGGING);
     game_free(game);
-}
\ No newline at end of file
+}
+
+// tests the packed bitboard: transpose round trip, merges in each direction and game over detection
+void test_bitboard()
+{
+    bitboard_init_tables();
+    int row_points = 0;
+    uint16_t row = bitboard_move_row_west(0x1111, &row_points); // 2 2 2 2 -> 4 4 0 0
+    printf("row table: 0x%04x (points: %d, expected 0x0022 and 8)\n", row, row_points);
+    board_t board = 0;
+    board = bitboard_set_tile(board, 0, 0, 2);
+    board = bitboard_set_tile(board, 0, 1, 2);
+    board = bitboard_set_tile(board, 0, 2, 4);
+    board = bitboard_set_tile(board, 1, 3, 8);
+    board = bitboard_set_tile(board, 3, 3, 8);
+    bitboard_print(board);
+    printf("transpose round trip: %s\n", bitboard_transpose(bitboard_transpose(board)) == board ? "ok" : "FAILED");
+    char *dir_names[4] = {"NORTH", "SOUTH", "EAST", "WEST"};
+    for(int dir = NORTH; dir <= WEST; dir++)
+    {
+        int points = 0;
+        board_t moved = bitboard_move(board, dir, &points);
+        printf("\n%s (points: %d)", dir_names[dir], points);
+        bitboard_print(moved);
+    }
+    // every whole-board kernel this CPU runs must match the row tables for every row in every direction
+    char *kernels[3] = {"scalar", "sse4", "avx2"};
+    for(int kernel = 0; kernel < 3; kernel++)
+    {
+        if(!bitboard_use_kernel(kernels[kernel]))
+        {
+            printf("%s kernel: not supported by this CPU\n", kernels[kernel]);
+            continue;
+        }
+        int mismatches = 0;
+        uint64_t mix = 0x9E3779B97F4A7C15ULL;
+        for(int row = 0; row < ROW_COUNT; row++)
+        {
+            // the row under test sits in a different line each time, the other lines are pseudo-random
+            mix = mix * 6364136223846793005ULL + 1442695040888963407ULL;
+            int line = row % BITBOARD_LENGTH;
+            board_t tested = (mix & ~(ROW_MASK << (line * ROW_BITS))) | ((board_t)row << (line * ROW_BITS));
+            for(int dir = NORTH; dir <= WEST; dir++)
+            {
+                int table_points = 0, kernel_points = 0;
+                uint8_t changed;
+                board_t expected = bitboard_move(tested, dir, &table_points);
+                board_t moved = bitboard_move_board(tested, dir, &kernel_points, &changed);
+                uint8_t lines = bitboard_line_moves(tested, dir); // lines the row tables say can move
+                if(moved != expected || kernel_points != table_points || changed != lines)
+                {
+                    mismatches++;
+                }
+            }
+        }
+        printf("%s kernel mismatches: %d (expected 0)\n", kernels[kernel], mismatches);
+    }
+    // full board with no merges left (checkerboard of 2s and 4s)
+    board_t full = 0;
+    for(int row = 0; row < BITBOARD_LENGTH; row++)
+    {
+        for(int col = 0; col < BITBOARD_LENGTH; col++)
+        {
+            full = bitboard_set_tile(full, row, col, (row + col) % 2 ? SPECIAL : STANDARD);
+        }
+    }
+    printf("full board running: %d (expected 0)\n", bitboard_running(full));
+    // every cell a 32768: equal neighbours everywhere, but no move changes the board
+    board_t capped = 0xFFFFFFFFFFFFFFFFULL;
+    uint8_t capped_running;
+    batch_running(&capped, &capped_running, 1);
+    printf("32768 board running: %d, batch: %d, legal moves: %d (expected 0 0 0)\n", bitboard_running(capped), capped_running,
+        bitboard_legal_moves(capped));
+}
+
+// plays random games and checks the incrementally cached move legality against a full recompute after every move
+void test_legal_moves()
+{
+    int mismatches = 0;
+    for(int seed = 0; seed < 100; seed++)
+    {
+        game_t *game = game_init(DEFAULT_BOARD_SIZE);
+        game_seed(game, seed);
+        place_random_tile(game);
+        while(game_running(game))
+        {
+            move_all(game, policy_random(game));
+            place_random_tile(game);
+            if(game_legal_moves(game) != bitboard_legal_moves(game->bitboard))
+            {
+                mismatches++;
+            }
+        }
+        game_free(game);
+    }
+    printf("legal move mismatches: %d (expected 0)\n", mismatches);
+}
+
+// writes more rows than one block holds from two writers, then maps the file and reads every row back
+void test_dataset()
+{
+    dataset_file_t *file = dataset_file_create("test_dataset.ds");
+    dataset_writer_t *first = dataset_writer_init(file);
+    dataset_writer_t *second = dataset_writer_init(file);
+    int rows = DATASET_BLOCK_ROWS + 100;
+    for(int index = 0; index < rows; index++)
+    {
+        dataset_writer_add(index % 2 ? second : first, (board_t)index * 0x9E3779B97F4A7C15ULL, index % 4, index, index % 7 == 0);
+    }
+    dataset_writer_free(first);
+    dataset_writer_free(second);
+    dataset_file_close(file);
+
+    dataset_t *dataset = dataset_open("test_dataset.ds");
+    long long checksum = 0, expected = 0;
+    for(uint64_t index = 0; index < dataset_row_count(dataset); index++)
+    {
+        board_t board;
+        int dir, reward, terminal;
+        dataset_row(dataset, index, &board, &dir, &reward, &terminal);
+        checksum += reward + (board == (board_t)reward * 0x9E3779B97F4A7C15ULL && dir == reward % 4 && terminal == (reward % 7 == 0));
+    }
+    for(int index = 0; index < rows; index++)
+    {
+        expected += index + 1;
+    }
+    printf("dataset rows: %llu (expected %d), checksum %s\n", (unsigned long long)dataset_row_count(dataset), rows,
+        checksum == expected ? "ok" : "FAILED");
+    dataset_close(dataset);
+
+    // a block claiming more rows than it holds must not be mapped
+    FILE *corrupt = fopen("test_dataset.ds", "r+b");
+    uint32_t row_count = DATASET_BLOCK_ROWS + 1;
+    fseek(corrupt, sizeof(dataset_header_t), SEEK_SET); // row_count of the first block
+    fwrite(&row_count, sizeof(row_count), 1, corrupt);
+    fclose(corrupt);
+    printf("corrupt dataset rejected: %d (expected 1)\n", dataset_open("test_dataset.ds") == NULL);
+    remove("test_dataset.ds");
+}
+
+void test_board_sizes()
+{
+    // play a random game on every board size, checking the empty list against the board after every move
+    for(int size = MIN_BOARD_SIZE; size <= MAX_BOARD_SIZE; size++)
+    {
+        game_t *game = game_init(size);
+        game_seed(game, size);
+        place_random_tile(game);
+        place_random_tile(game);
+        int moves = 0, mismatches = 0;
+        while(game_running(game))
+        {
+            int dir = policy_random(game);
+            int moved = game_can_move(game, dir);
+            move_all(game, dir);
+            if(moved)
+            {
+                place_random_tile(game);
+            }
+            int empty = 0;
+            for(int row = START; row <= size; row++)
+            {
+                for(int col = START; col <= size; col++)
+                {
+                    empty += game->board[row][col] == EMPTY;
+                    mismatches += (game->board[row][col] == EMPTY) != empty_list_contains(game->empty_list, row, col);
+                }
+            }
+            mismatches += empty != game->empty_list->length;
+            moves++;
+        }
+        printf("%dx%d: %d moves, %d points, highest tile %d, empty list %s, edges %s\n", size, size, moves, game->points,
+            game->highest_tile, mismatches == 0 ? "ok" : "FAILED",
+            game->board[0][1] == EDGE && game->board[size + 1][size] == EDGE && is_edge(size, size + 1, 1) ? "ok" : "FAILED");
+        game_free(game);
+    }
+    printf("unsupported size: %s\n", game_init(MAX_BOARD_SIZE + 1) == NULL ? "ok" : "FAILED");
+}
+
+// plays a batch of boards in lockstep next to the same boards played one at a time, every step must match
+void test_batch()
+{
+    int count = 256;
+    board_batch_t *batch = board_batch_init(count);
+    board_t boards[256];
+    rng_t rngs[256];
+    for(int index = 0; index < count; index++)
+    {
+        board_batch_seed(batch, index, index);
+        rng_seed(&rngs[index], index);
+        boards[index] = bitboard_place_random_tile(0, &rngs[index]);
+    }
+    batch_spawn(batch->boards, batch->rng, batch->running, count); // every board starts running, so each gets a tile
+    int mismatches = 0, running = count;
+    for(int step = 0; step < 2000 && running > 0; step++)
+    {
+        running = 0;
+        for(int index = 0; index < count; index++)
+        {
+            batch->dirs[index] = (index * 7 + step * 3 + step / 5) % 4;
+        }
+        board_batch_step(batch);
+        for(int index = 0; index < count; index++)
+        {
+            int points = 0;
+            board_t moved = bitboard_move(boards[index], batch->dirs[index], &points);
+            if(moved != boards[index])
+            {
+                moved = bitboard_place_random_tile(moved, &rngs[index]);
+            }
+            boards[index] = moved;
+            running += bitboard_running(moved);
+            if(batch->boards[index] != moved || batch->points[index] != points || batch->running[index] != bitboard_running(moved))
+            {
+                mismatches++;
+            }
+        }
+    }
+    printf("batch mismatches: %d (expected 0), boards still running: %d\n", mismatches, running);
+    board_batch_free(batch);
+}
+
+// plays a game while recording it, then undoes every move and redoes them again, checking each turn against the game played
+void test_history()
+{
+    game_t *game = random_game_init(3);
+    game_history_t *history = history_init();
+    static board_t boards[HISTORY_CAPACITY];
+    static int points[HISTORY_CAPACITY];
+    history_reset(history, game);
+    long turns = 0;
+    boards[0] = game->bitboard;
+    while(game_running(game))
+    {
+        if(random_game_step(game))
+        {
+            history_record(history, game);
+            turns++;
+            boards[turns] = game->bitboard;
+            points[turns] = game->points;
+        }
+    }
+    int mismatches = 0;
+    for(long turn = turns - 1; turn >= 0; turn--)
+    {
+        history_undo(history, game);
+        int empty = bitboard_count_empty(game->bitboard);
+        mismatches += game->bitboard != boards[turn] || game->points != points[turn] || game->empty_list->length != empty;
+    }
+    printf("undo past the first turn: %d (expected 0)\n", history_undo(history, game));
+    for(long turn = 1; turn <= turns; turn++)
+    {
+        history_redo(history, game);
+        mismatches += game->bitboard != boards[turn] || game->points != points[turn];
+    }
+    printf("history mismatches over %ld turns: %d (expected 0), game running: %d (expected 0)\n", turns, mismatches, game_running(game));
+    history_free(history);
+    game_free(game);
+
+    // tiles of 6x6 boards pass 2^15, their exponents do not fit in 4 bits
+    game = game_init(MAX_BOARD_SIZE);
+    game->board[START][START] = 1 << 16;
+    game->board[START][START + 1] = 1 << 17;
+    game->board[START + MAX_BOARD_SIZE - 1][START + MAX_BOARD_SIZE - 1] = 2;
+    game_snapshot_t snapshot;
+    game_snapshot(game, &snapshot);
+    game_reset(game);
+    game_restore(game, &snapshot);
+    printf("6x6 restored: %d %d %d, highest tile: %d (expected 65536 131072 2, 131072), empty: %d (expected 33)\n",
+        game->board[START][START], game->board[START][START + 1], game->board[START + MAX_BOARD_SIZE - 1][START + MAX_BOARD_SIZE - 1],
+        game->highest_tile, game->empty_list->length);
+    game_free(game);
+}
+
+// plays seeded games with the rollout player, serial play has to repeat itself and every move has to be legal
+void test_rollout()
+{
+    rollout_set_budget(32, 0);
+    board_t finals[2];
+    int illegal = 0;
+    for(int run = 0; run < 4; run++)
+    {
+        rollout_set_threads(run < 2 ? 1 : run == 2 ? 4 : 2); // the last runs use the pool, then fewer threads than it has
+        game_t *game = random_game_init(11);
+        while(game_running(game))
+        {
+            int dir = policy_rollout(game);
+            illegal += !game_can_move(game, dir);
+            move_all(game, dir);
+            place_random_tile(game);
+        }
+        if(run < 2)
+        {
+            finals[run] = game->bitboard;
+        }
+        printf("rollout game %d: %d points, highest tile %d\n", run, game->points, game->highest_tile);
+        game_free(game);
+    }
+    long playouts;
+    double seconds;
+    rollout_stats(&playouts, &seconds);
+    printf("serial games match: %d (expected 1), illegal moves: %d (expected 0), rollouts/sec: %.1f\n",
+        finals[0] == finals[1], illegal, playouts / seconds);
+}
+
+// checks the 8 symmetries on boards of random games: undoing, canonical boards, and moves mapped through them
+void test_symmetry()
+{
+    game_t *game = random_game_init(5);
+    int boards = 0;
+    int mismatches = 0;
+    while(game_running(game))
+    {
+        board_t board = game->bitboard;
+        board_t canonical = bitboard_canonical(board, NULL);
+        for(int transform = 0; transform < 8; transform++)
+        {
+            board_t transformed = bitboard_transform(board, transform);
+            int canonical_transform;
+            mismatches += bitboard_transform(transformed, symmetry_inverse(transform)) != board;
+            mismatches += bitboard_canonical(transformed, &canonical_transform) != canonical;
+            mismatches += bitboard_transform(transformed, canonical_transform) != canonical;
+            mismatches += bitboard_symmetric_hash(transformed) != bitboard_symmetric_hash(board);
+            for(int dir = NORTH; dir <= WEST; dir++)
+            {
+                int points = 0;
+                int mapped_points = 0;
+                board_t moved = bitboard_move(board, dir, &points);
+                board_t mapped = bitboard_move(transformed, symmetry_map_dir(dir, transform), &mapped_points);
+                mismatches += bitboard_transform(moved, transform) != mapped || points != mapped_points;
+            }
+        }
+        for(int dir = NORTH; dir <= WEST; dir++)
+        {
+            int points = 0;
+            int canonical_points = 0;
+            int moved;
+            board_t expected = bitboard_move(board, dir, &points);
+            mismatches += bitboard_move_canonical(board, dir, &canonical_points, &moved) != expected ||
+                canonical_points != points || moved != (expected != board);
+        }
+        boards++;
+        random_game_step(game);
+    }
+    printf("symmetry mismatches over %d boards: %d (expected 0)\n", boards, mismatches);
+    game_free(game);
+}
+
+// trains a network on the boards of one game, then checks symmetric values and a save and map round trip
+void test_ntuple()
+{
+    ntuple_net_t *net = ntuple_create();
+    game_t *game = random_game_init(9);
+    int asymmetric = 0;
+    int not_raised = 0;
+    while(game_running(game))
+    {
+        board_t board = game->bitboard;
+        float value = ntuple_value(net, board);
+        ntuple_update(net, board, 100.0f);
+        not_raised += ntuple_value(net, board) <= value;
+        for(int transform = 1; transform < 8; transform++)
+        {
+            float difference = ntuple_value(net, bitboard_transform(board, transform)) - ntuple_value(net, board);
+            asymmetric += difference * difference > 1e-4f; // the same weights are only summed in another order
+        }
+        random_game_step(game);
+    }
+    printf("asymmetric values: %d (expected 0), updates that did not raise the value: %d (expected 0)\n", asymmetric, not_raised);
+    char *path = "test_ntuple.weights";
+    int saved = ntuple_save(net, path);
+    ntuple_net_t *mapped = ntuple_open(path, 0);
+    int mismatches = mapped == NULL || memcmp(mapped->weights, net->weights, NTUPLE_COUNT * NTUPLE_ENTRIES * sizeof(float)) != 0;
+    printf("saved: %d (expected 1), mapped weights differ: %d (expected 0)\n", saved, mismatches);
+    if(mapped != NULL)
+    {
+        ntuple_free(mapped);
+    }
+    remove(path);
+    ntuple_free(net);
+    game_free(game);
+}
+
+// work of test_thread_pool(): counts the workers that ran and marks which ones
+static void count_worker(void *arg, int worker)
+{
+    atomic_int *counts = arg;
+    atomic_fetch_add(&counts[0], 1);
+    atomic_fetch_or(&counts[1], 1 << worker);
+}
+
+// grows a pool to 8 threads, then runs batches on fewer: only the first workers may run and every batch has to end
+void test_thread_pool()
+{
+    thread_pool_t *pool = thread_pool_init();
+    int wrong = 0;
+    int threads[6] = {8, 2, 2, 1, 5, 2};
+    for(int round = 0; round < 600; round++)
+    {
+        int count = threads[round % 6];
+        atomic_int counts[2] = {0, 0};
+        thread_pool_run(pool, count, count_worker, counts);
+        wrong += atomic_load(&counts[0]) != count || atomic_load(&counts[1]) != (1 << count) - 1;
+    }
+    printf("thread pool batches with the wrong workers: %d (expected 0)\n", wrong);
+
+    // the search pool is lowered the same way, moves have to keep coming back
+    ai_set_time_budget(5);
+    game_t *game = random_game_init(13);
+    int illegal = 0;
+    for(int move = 0; move < 20 && game_running(game); move++)
+    {
+        ai_set_threads(move % 2 == 0 ? 8 : 2);
+        int dir = suggest_move(game);
+        illegal += !game_can_move(game, dir);
+        move_all(game, dir);
+        place_random_tile(game);
+    }
+    printf("expectimax moves after lowering its threads, illegal: %d (expected 0)\n", illegal);
+    ai_set_threads(1);
+    game_free(game);
+}
@@ -0,0 +1,172 @@
+#include "2048.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+    Trainer of the n-tuple network ("2048_ntuple.c") by temporal difference self-play
+
+    Every thread plays whole games through move_all() and place_random_tile(), always taking
+    the move with the best points plus value of the board right after it (its afterstate).
+    After each move the value of the previous afterstate is pulled towards the points of this
+    move plus the value of this afterstate, TD(0) on afterstates; the last afterstate of a game
+    is pulled towards 0. All threads update one shared network without locks (Hogwild!).
+
+    Every checkpoint games the network is saved (through a temporary file, so the weights file
+    is always whole) and one line of progress is printed. Training resumes from the weights
+    file if it exists.
+
+    usage: ./train [games] [threads] [weights] [seed] [rate] [checkpoint]
+*/
+
+#define MAX_THREADS 256
+
+// settings and counters shared by every training thread
+typedef struct
+{
+    ntuple_net_t *net;
+    char *path; // weights file the checkpoints are written to
+    long games; // amount of games to play in this run
+    long checkpoint; // games between two checkpoints
+    uint64_t seed;
+    float rate; // learning rate, the share of the TD error added to each afterstate's value
+    atomic_long next_game; // index of the next game to be played
+    atomic_long interval_games; // games finished since the last progress line
+    atomic_long interval_points;
+    atomic_long interval_wins; // games since the last progress line that reached 2048
+    atomic_long moves;
+    pthread_mutex_t report_lock; // keeps two checkpoints from writing the file at once
+    long long start; // now_ns() when training started
+    int threads;
+    int cores; // cores the threads run on, the smaller of threads and the amount of cores
+}
+trainer_t;
+
+static trainer_t trainer = {.report_lock = PTHREAD_MUTEX_INITIALIZER};
+
+/*
+    Plays one game with the network and learns from it on the way
+    Returns the amount of moves made
+*/
+static long train_game(game_t *game)
+{
+    ntuple_net_t *net = trainer.net;
+    long moves = 0;
+    board_t previous = 0; // afterstate of the previous move
+    float previous_value = 0.0f;
+    while(game_running(game))
+    {
+        board_t after;
+        float score;
+        float value;
+        int dir = ntuple_best_move(net, game->bitboard, &after, &score, &value);
+        if(moves > 0) // score is the points of this move plus the value of its afterstate
+        {
+            ntuple_update(net, previous, trainer.rate * (score - previous_value));
+        }
+        move_all(game, dir);
+        place_random_tile(game);
+        previous = after;
+        previous_value = value; // looked up before the update above, weights shared with the previous afterstate may have moved a little since
+        moves++;
+    }
+    if(moves > 0) // nothing comes after the last afterstate
+    {
+        ntuple_update(net, previous, trainer.rate * -previous_value);
+    }
+    return moves;
+}
+
+// saves the network and prints the progress since the last checkpoint
+static void checkpoint(long games)
+{
+    pthread_mutex_lock(&trainer.report_lock);
+    long interval_games = atomic_exchange(&trainer.interval_games, 0);
+    long interval_points = atomic_exchange(&trainer.interval_points, 0);
+    long interval_wins = atomic_exchange(&trainer.interval_wins, 0);
+    double seconds = (now_ns() - trainer.start) / 1e9;
+    trainer.net->header->games += interval_games;
+    int saved = ntuple_save(trainer.net, trainer.path);
+    printf("games: %ld, games/sec per core: %.1f, mean score: %.1f, reached 2048: %.1f%%%s\n", games,
+        games / seconds / trainer.cores, interval_games > 0 ? (double)interval_points / interval_games : 0.0,
+        interval_games > 0 ? 100.0 * interval_wins / interval_games : 0.0, saved ? "" : " (cannot write weights)");
+    fflush(stdout);
+    pthread_mutex_unlock(&trainer.report_lock);
+}
+
+// thread body: take the next game until every game of the run was played
+static void *train_worker_run(void *arg)
+{
+    game_t *game = arg;
+    long index;
+    while((index = atomic_fetch_add(&trainer.next_game, 1)) < trainer.games)
+    {
+        game_reset(game);
+        game_seed(game, rng_mix_seed(trainer.seed, index));
+        place_random_tile(game);
+        place_random_tile(game);
+        atomic_fetch_add(&trainer.moves, train_game(game));
+        atomic_fetch_add(&trainer.interval_points, game->points);
+        atomic_fetch_add(&trainer.interval_wins, game->highest_tile >= 2048);
+        atomic_fetch_add(&trainer.interval_games, 1);
+        if((index + 1) % trainer.checkpoint == 0 && index + 1 < trainer.games)
+        {
+            checkpoint(index + 1);
+        }
+    }
+    move_cache_flush_stats();
+    return NULL;
+}
+
+/*
+    This main method trains the n-tuple
+    network on many threads and writes
+    its weights to a file that the other
+    programs map with ntuple_use_weights()
+
+    usage: ./train [games] [threads] [weights] [seed] [rate] [checkpoint]
+    threads defaults to the amount of cores, weights to "ntuple.weights", rate to 0.1 and checkpoint to 1000 games
+*/
+int main(int argc, char **argv)
+{
+    trainer.games = argc > 1 ? atol(argv[1]) : 10000;
+    trainer.threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    trainer.path = argc > 3 ? argv[3] : NTUPLE_DEFAULT_PATH;
+    trainer.seed = argc > 4 ? strtoull(argv[4], NULL, 10) : (uint64_t)time(NULL);
+    trainer.rate = argc > 5 ? atof(argv[5]) : 0.1f;
+    trainer.checkpoint = argc > 6 ? atol(argv[6]) : 1000;
+    if(trainer.games <= 0 || trainer.threads <= 0 || trainer.threads > MAX_THREADS || trainer.rate <= 0.0f || trainer.checkpoint <= 0)
+    {
+        printf("usage: %s [games] [threads] [weights] [seed] [rate] [checkpoint]\n", argv[0]);
+        return 1;
+    }
+    int online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    trainer.cores = trainer.threads < online ? trainer.threads : online;
+    bitboard_init_tables();
+    trainer.net = ntuple_open(trainer.path, 1); // resume from the last checkpoint if there is one
+    if(trainer.net == NULL)
+    {
+        trainer.net = ntuple_create();
+    }
+    printf("weights: %s (%llu games trained), threads: %d, seed: %llu, rate: %g\n", trainer.path,
+        (unsigned long long)trainer.net->header->games, trainer.threads, (unsigned long long)trainer.seed, trainer.rate);
+
+    game_pool_t *games = game_pool_init(trainer.threads, DEFAULT_BOARD_SIZE);
+    pthread_t *threads = malloc(sizeof(pthread_t) * trainer.threads);
+    trainer.start = now_ns();
+    for(int id = 0; id < trainer.threads; id++)
+    {
+        pthread_create(&threads[id], NULL, train_worker_run, game_pool_acquire(games));
+    }
+    for(int id = 0; id < trainer.threads; id++)
+    {
+        pthread_join(threads[id], NULL);
+    }
+    checkpoint(trainer.games);
+    double seconds = (now_ns() - trainer.start) / 1e9;
+    printf("trained %ld games (%ld moves) in %.3f seconds, games/sec per core: %.1f, moves/sec: %.1f\n", trainer.games,
+        atomic_load(&trainer.moves), seconds, trainer.games / seconds / trainer.cores, atomic_load(&trainer.moves) / seconds);
+    free(threads);
+    game_pool_free(games);
+    ntuple_free(trainer.net);
+    return 0;
+}